@@ -0,0 +1,71 @@
+# tuftc.cmake
+#
+# Compiles mustache templates into C++ headers at build time with tools/tuftc.cpp.
+#
+#   include(path/to/tuft/cmake/tuftc.cmake)
+#
+#   tuft_compile_templates(<target>
+#       TEMPLATES  templates/page.mustache templates/row.mustache
+#       [NAMESPACE templates]
+#       [OPEN  "<%"]
+#       [CLOSE "%>"]
+#       [ESCAPE html|none|json|url|js])
+#
+# Each template becomes <binary dir>/tuft_templates/<name>.hpp with templates::render_<name>(). The target gets
+# that directory and tuft's own directory on its include path and is rebuilt when a template changes.
+# nlohmann_json must be available through find_package() to build the tuftc tool.
+
+set(TUFT_ROOT_DIR "${CMAKE_CURRENT_LIST_DIR}/.." CACHE INTERNAL "")
+
+function(tuft_compile_templates target)
+    cmake_parse_arguments(TUFTC "" "NAMESPACE;OPEN;CLOSE;ESCAPE" "TEMPLATES" ${ARGN})
+
+    if (NOT TARGET tuftc)
+        find_package(nlohmann_json REQUIRED)
+
+        add_executable(tuftc "${TUFT_ROOT_DIR}/tools/tuftc.cpp")
+        target_compile_features(tuftc PRIVATE cxx_std_17)
+        target_link_libraries(tuftc PRIVATE nlohmann_json::nlohmann_json)
+    endif()
+
+    set(options "")
+
+    if (TUFTC_NAMESPACE)
+        list(APPEND options --namespace "${TUFTC_NAMESPACE}")
+    endif()
+
+    if (TUFTC_OPEN)
+        list(APPEND options --open "${TUFTC_OPEN}")
+    endif()
+
+    if (TUFTC_CLOSE)
+        list(APPEND options --close "${TUFTC_CLOSE}")
+    endif()
+
+    if (TUFTC_ESCAPE)
+        list(APPEND options --escape "${TUFTC_ESCAPE}")
+    endif()
+
+    set(output_dir "${CMAKE_CURRENT_BINARY_DIR}/tuft_templates")
+    file(MAKE_DIRECTORY "${output_dir}")
+
+    set(headers "")
+
+    foreach (template IN LISTS TUFTC_TEMPLATES)
+        get_filename_component(input "${template}" ABSOLUTE)
+        get_filename_component(name "${template}" NAME_WE)
+        set(header "${output_dir}/${name}.hpp")
+
+        add_custom_command(
+            OUTPUT  "${header}"
+            COMMAND tuftc "${input}" "${header}" --name "${name}" ${options}
+            DEPENDS tuftc "${input}"
+            COMMENT "Compiling template ${template}"
+            VERBATIM)
+
+        list(APPEND headers "${header}")
+    endforeach()
+
+    target_sources(${target} PRIVATE ${headers})
+    target_include_directories(${target} PRIVATE "${output_dir}" "${TUFT_ROOT_DIR}")
+endfunction()
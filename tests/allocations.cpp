@@ -0,0 +1,147 @@
+/*
+ * Copyright 2016 Charles Jared Jetsel
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the "Software"), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons
+ * to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * allocations
+ *
+ * @brief   Checks that the render paths which promise not to allocate stay that way
+ */
+
+#include <cstddef>
+
+#include "check.hpp"
+#include "count_allocations.hpp"
+#include "tuft.hpp"
+
+namespace
+{
+    using tuft_test::check;
+
+    /** @brief Interpolated string tags are looked up by reference and appended, nothing is copied */
+    void string_tags()
+    {
+        const tuft::json_t hash = {{"name", "a value that is too long for the small string buffer <&>"}, {"other", "x"}};
+
+        for (int tags : {10, 100, 1000})
+        {
+            tuft::template_t templ;
+
+            for (int i = 0; i < tags; ++i)
+                templ += "<p>{{name}} {{{name}}} {{&other}}</p>";
+
+            const auto compiled = tuft::compile(templ);
+            tuft::string_t out;
+            tuft::render_into(out, compiled, hash); // grows the buffer once
+
+            check(tuft_test::count_allocations([&] { tuft::render_into(out, compiled, hash); }) == 0,
+                  "string tags allocate when rendered into a buffer that is large enough");
+        }
+    }
+
+    /** @brief Rendering a template string classifies its tags without allocating, so the count doesn't grow with them */
+    void template_string()
+    {
+        const tuft::json_t hash = {{"name", "a value that is too long for the small string buffer <&>"}, {"list", {1, 2, 3}}, {"flag", true}};
+        long first = -1;
+
+        for (int repeats : {10, 100, 1000})
+        {
+            tuft::template_t templ;
+
+            for (int i = 0; i < repeats; ++i)
+                templ += "text {{name}} {{{name}}} {{& name }} {{#list}}[{{.}}]{{/list}} {{^flag}}no{{/flag}} ";
+
+            tuft::string_t out;
+            tuft::render_into(out, templ, hash); // grows the buffer once
+
+            const long allocations = tuft_test::count_allocations([&] { tuft::render_into(out, templ, hash); });
+
+            if (first < 0)
+                first = allocations;
+
+            check(allocations <= 8, "rendering a template string makes more than a few allocations");
+            check(allocations == first, "allocations of a template string render grow with its tags");
+        }
+    }
+
+    /** @brief render_to() fills the caller's buffer and nothing else, also when the output doesn't fit */
+    void fixed_buffer()
+    {
+        const tuft::json_t hash = {{"name", "a value <&>"}, {"list", {1, 2.5, "x"}}};
+        const auto compiled = tuft::compile("<p>{{name}}</p>{{#list}}[{{.}}]{{/list}}");
+        const tuft::string_t expected = tuft::render(compiled, hash);
+
+        for (size_t capacity : {size_t(0), size_t(1), size_t(10), expected.size(), expected.size() + 1, size_t(256)})
+        {
+            char buffer[256];
+            tuft::render_result result;
+
+            check(tuft_test::count_allocations([&] { result = tuft::render_to(buffer, capacity, compiled, hash); }) == 0,
+                  "render_to allocates");
+            check(result.size == expected.size(), "render_to reports the wrong size");
+            check(result.truncated() == (capacity <= expected.size()), "render_to reports truncation wrongly");
+
+            if (capacity != 0)
+                check(tuft::string_t(buffer) == expected.substr(0, capacity - 1), "render_to writes the wrong prefix");
+        }
+
+        // A render that fails leaves an empty string behind. The depth limit of a loaded template is only checked when it is rendered.
+        tuft::options_t options;
+        options.max_depth = 2;
+
+        tuft::string_t blob = tuft::serialize(tuft::compile("{{name}}{{#a}}{{#a}}x{{/a}}{{/a}}", options));
+        blob[offsetof(tuft::detail::blob_header, max_depth)] = 1;
+
+        const auto limited = tuft::deserialize(blob);
+        const tuft::json_t nested = {{"name", "abc"}, {"a", {{"a", true}}}};
+
+        char buffer[16] = "unchanged";
+        tuft_test::check_throws<tuft::exception>([&] { tuft::render_to(buffer, sizeof(buffer), limited, nested); }, "render_to doesn't stop at max_depth");
+        check(buffer[0] == '\0', "render_to leaves a failed render unterminated");
+    }
+
+    /** @brief Sections reserve room for the literals that every element renders, not for those of nested sections */
+    void section_reservation()
+    {
+        tuft::json_t rows = tuft::json_t::array();
+
+        for (int i = 0; i < 5000; ++i)
+            rows.push_back({{"admin", false}});
+
+        const auto compiled = tuft::compile("{{#rows}}<tr>{{#admin}}" + tuft::string_t(20000, 'x') + "{{/admin}}</tr>{{/rows}}");
+
+        tuft::string_t out;
+        tuft::render_append(out, compiled, {{"rows", rows}});
+
+        check(out.size() == 5000 * 9, "conditional section renders the wrong output");
+        check(out.capacity() < 2 * out.size(), "section reserves room for a nested section that isn't rendered");
+    }
+}
+
+int main()
+{
+    string_tags();
+    template_string();
+    fixed_buffer();
+    section_reservation();
+
+    return tuft_test::result("allocations");
+}
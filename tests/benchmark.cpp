@@ -0,0 +1,156 @@
+/*
+ * Copyright 2016 Charles Jared Jetsel
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the "Software"), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons
+ * to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * benchmark
+ *
+ * @brief   Times the renderer and reports the heap allocations it makes
+ *
+ * Usage:   benchmark [iterations]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "count_allocations.hpp"
+#include "tuft.hpp"
+
+namespace
+{
+    /** @brief Prints the time per render and the allocations per tag of f, which renders a template with tags tags */
+    template <typename F>
+    void measure(const char* name, int iterations, size_t tags, F&& f)
+    {
+        f(); // warm up, buffers reach their size
+
+        const long before = tuft_test::allocations.load();
+        const auto start  = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < iterations; ++i)
+            f();
+
+        const auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        const long allocations = tuft_test::allocations.load() - before;
+
+        std::printf("%-28s %10.2f us/render %8.3f allocations/tag\n", name, elapsed / iterations,
+                    static_cast<double>(allocations) / (static_cast<double>(iterations) * tags));
+    }
+
+    /** @brief Interpolated string tags, the common case of a page */
+    void string_tags(int iterations)
+    {
+        const tuft::json_t hash = {{"name", "a value that is too long for the small string buffer <&>"}, {"title", "Title"}};
+        const size_t tags = 1000;
+
+        tuft::template_t templ;
+
+        for (size_t i = 0; i < tags / 2; ++i)
+            templ += "<p>{{name}}</p><h2>{{{title}}}</h2>\n";
+
+        const auto compiled = tuft::compile(templ);
+        tuft::string_t out;
+
+        measure("string tags", iterations, tags, [&] { tuft::render_into(out, compiled, hash); });
+    }
+
+    /**
+     * walk
+     *
+     * @brief   Renders nodes [first, last) by recursing into sections, the way tuft rendered before the interpreter loop.
+     *          It is the baseline the interpreter is compared with.
+     */
+    void walk(const tuft::compiled_template& compiled, tuft::string_t& out, const tuft::json_t& context, size_t first, size_t last)
+    {
+        using tuft::detail::node_type;
+
+        const auto nodes = compiled.nodes();
+
+        for (size_t n = first; n < last; ++n)
+        {
+            const auto& tag = nodes[n];
+
+            switch (tag.type)
+            {
+                case node_type::literal:
+                    out.append(compiled.text(tag));
+                    break;
+
+                case node_type::variable:
+                    if (const tuft::json_t* value = tuft::detail::find_value(context, compiled.text(tag), tag.implicit))
+                        tuft::detail::append_value(out, *value, tag.escape);
+                    break;
+
+                case node_type::section:
+                case node_type::inverted_section:
+                {
+                    const tuft::json_t& section = tuft::detail::find_section(context, compiled.text(tag));
+
+                    if (tuft::detail::is_section_rendered(section, tag.type == node_type::inverted_section))
+                        tuft::detail::for_each_element(section, [&](const tuft::json_t& element) { walk(compiled, out, element, n + 1, tag.end); });
+
+                    n = tag.end - 1;
+                    break;
+                }
+            }
+        }
+    }
+
+    /** @brief Nested sections over arrays, where the interpreter loop replaces recursion */
+    void sections(int iterations)
+    {
+        tuft::json_t rows = tuft::json_t::array();
+
+        for (int i = 0; i < 100; ++i)
+            rows.push_back({{"id", i}, {"name", "row <" + std::to_string(i) + ">"}, {"tags", {"a", "b", "c"}}, {"hidden", i % 3 == 0}});
+
+        const tuft::json_t hash = {{"title", "Table"}, {"rows", rows}};
+        const auto compiled = tuft::compile("<h1>{{title}}</h1><table>{{#rows}}<tr><td>{{id}}</td><td>{{name}}</td>"
+                                            "<td>{{#tags}}<i>{{.}}</i>{{/tags}}</td>{{^hidden}}<td>shown</td>{{/hidden}}</tr>{{/rows}}</table>");
+
+        // Each row interpolates the id, the name and three tags, and opens two sections. The title is one more.
+        const size_t tags = 1 + 100 * 7;
+        tuft::string_t out;
+
+        measure("sections, interpreter", iterations, tags, [&] { tuft::render_into(out, compiled, hash); });
+        measure("sections, tree walk", iterations, tags, [&]
+        {
+            out.clear();
+            tuft::detail::for_each_element(hash, [&](const tuft::json_t& element) { walk(compiled, out, element, 0, compiled.nodes().size()); });
+        });
+
+        tuft::string_t walked;
+        tuft::detail::for_each_element(hash, [&](const tuft::json_t& element) { walk(compiled, walked, element, 0, compiled.nodes().size()); });
+
+        if (walked != tuft::render(compiled, hash))
+            std::printf("tree walk and interpreter outputs differ\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const int iterations = argc > 1 ? std::atoi(argv[1]) : 1000;
+
+    string_tags(iterations);
+    sections(iterations);
+
+    return 0;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2016 Charles Jared Jetsel
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the "Software"), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons
+ * to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * check
+ *
+ * @brief   Minimal assertions for the tests. Failures are printed and counted, main() returns result().
+ */
+
+#pragma once
+
+#include <cstdio>
+
+namespace tuft_test
+{
+    inline int failures = 0;
+
+    inline void check(bool ok, const char* what)
+    {
+        if (!ok)
+        {
+            std::printf("FAILED: %s\n", what);
+            ++failures;
+        }
+    }
+
+    /** @brief Checks that f throws E */
+    template <typename E, typename F>
+    void check_throws(F&& f, const char* what)
+    {
+        try
+        {
+            f();
+        }
+        catch (const E&)
+        {
+            return;
+        }
+        catch (...)
+        {
+        }
+
+        check(false, what);
+    }
+
+    /** @return Exit code of the test */
+    inline int result(const char* name)
+    {
+        if (failures == 0)
+            std::printf("%s: all passed\n", name);
+
+        return failures == 0 ? 0 : 1;
+    }
+}
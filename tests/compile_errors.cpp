@@ -0,0 +1,75 @@
+/*
+ * Copyright 2016 Charles Jared Jetsel
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the "Software"), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons
+ * to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * compile_errors
+ *
+ * @brief   Checks that malformed templates and options are rejected with tuft::exception
+ */
+
+#include <string>
+
+#include "check.hpp"
+#include "tuft.hpp"
+
+namespace
+{
+    using tuft_test::check;
+    using tuft_test::check_throws;
+
+    const tuft::json_t hash = {{"a", 1}};
+
+    /** @brief An empty delimiter would be found at the same place forever */
+    void empty_delimiters()
+    {
+        check_throws<tuft::exception>([] { tuft::compile("hello a}} world", tuft::options_t("", "}}")); }, "empty open delimiter");
+        check_throws<tuft::exception>([] { tuft::compile("hello {{a world", tuft::options_t("{{", "")); }, "empty close delimiter");
+        check_throws<tuft::exception>([] { tuft::compile("hello", tuft::options_t("", "")); }, "empty delimiters");
+        check_throws<tuft::exception>([] { tuft::render("hello a}} world", hash, tuft::options_t("", "}}")); }, "render with an empty open delimiter");
+    }
+
+    /** @brief The close delimiter of a tag must follow its open delimiter, not overlap it */
+    void overlapping_delimiters()
+    {
+        check_throws<tuft::exception>([] { tuft::compile("c<%>", tuft::options_t("<%", "%>")); }, "overlapping delimiters");
+        check_throws<tuft::exception>([] { tuft::compile("{{}", tuft::options_t("{{", "}}")); }, "overlapping mustaches");
+        check_throws<tuft::exception>([] { tuft::compile(std::string(30, '%'), tuft::options_t("%", std::string(64, '%'))); },
+                                      "close delimiter longer than the template");
+
+        check(tuft::render("c<%a%>", hash, tuft::options_t("<%", "%>")) == "c1", "tag right after an overlapping prefix");
+    }
+
+    void unclosed()
+    {
+        check_throws<tuft::exception>([] { tuft::compile("{{a"); }, "unclosed tag");
+        check_throws<tuft::exception>([] { tuft::compile("{{#a}}x"); }, "unclosed section");
+        check_throws<tuft::exception>([] { tuft::compile("{{#a}}x{{/b}}"); }, "mismatched section");
+    }
+}
+
+int main()
+{
+    empty_delimiters();
+    overlapping_delimiters();
+    unclosed();
+
+    return tuft_test::result("compile_errors");
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2016 Charles Jared Jetsel
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the "Software"), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons
+ * to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * deserialize
+ *
+ * @brief   Feeds corrupted serialized templates to tuft::deserialize(). Each one is either rejected with
+ *          tuft::exception or renders without reading out of bounds, looping or reserving absurd amounts.
+ */
+
+#include <cstddef>
+
+#include "check.hpp"
+#include "tuft.hpp"
+
+namespace
+{
+    using tuft_test::check;
+    using tuft_test::check_throws;
+
+    using tuft::detail::node;
+
+    const tuft::json_t hash = {{"name", "<b>"}, {"list", {{{"x", 1}}, {{"x", 2}}}}, {"flag", false}};
+
+    tuft::string_t blob()
+    {
+        return tuft::serialize(tuft::compile("<h1>{{name}}</h1>{{#list}}<p>{{x}}{{.}}</p>{{/list}}{{^flag}}no{{/flag}}{{{name}}}"));
+    }
+
+    /** @return Offset of a field of the node at index in a serialized template */
+    size_t node_field(size_t index, size_t field)
+    {
+        return sizeof(tuft::detail::blob_header) + index * sizeof(node) + field;
+    }
+
+    /** @brief Deserializes data and renders it if it is accepted. Output size is bounded by the template, so it stays small. */
+    void load_and_render(const tuft::string_t& data)
+    {
+        try
+        {
+            const auto compiled = tuft::deserialize(data);
+            const auto rendered = tuft::render(compiled, hash);
+
+            check(rendered.capacity() < 64 * 1024, "corrupted template reserves too much");
+        }
+        catch (const tuft::exception&)
+        {
+        }
+    }
+
+    /** @brief Fields that the renderer trusts are rejected when they are out of range */
+    void invalid_fields()
+    {
+        const tuft::string_t good = blob();
+        check(tuft::render(tuft::deserialize(good), hash) == tuft::render(tuft::compile("<h1>{{name}}</h1>{{#list}}<p>{{x}}{{.}}</p>{{/list}}{{^flag}}no{{/flag}}{{{name}}}"), hash),
+              "serialized template renders differently");
+
+        auto corrupt = [&](size_t offset, unsigned char value)
+        {
+            tuft::string_t data = good;
+            data[offset] = static_cast<char>(value);
+            return data;
+        };
+
+        check_throws<tuft::exception>([&] { tuft::deserialize(corrupt(node_field(1, offsetof(node, type)), 0x80)); }, "node type with the sign bit set");
+        check_throws<tuft::exception>([&] { tuft::deserialize(corrupt(node_field(1, offsetof(node, type)), 4)); }, "node type past the last one");
+        check_throws<tuft::exception>([&] { tuft::deserialize(corrupt(node_field(1, offsetof(node, escape)), 65)); }, "escape flag that isn't a bool");
+        check_throws<tuft::exception>([&] { tuft::deserialize(corrupt(node_field(1, offsetof(node, implicit)), 2)); }, "implicit flag that isn't a bool");
+        check_throws<tuft::exception>([&] { tuft::deserialize(corrupt(node_field(3, offsetof(node, literal_length) + 3), 0x7F)); }, "huge literal length");
+        check_throws<tuft::exception>([&] { tuft::deserialize(corrupt(node_field(3, offsetof(node, end)), 0xFF)); }, "section end past the nodes");
+        check_throws<tuft::exception>([&] { tuft::deserialize(corrupt(offsetof(tuft::detail::blob_header, escape), 9)); }, "unknown escape policy");
+        check_throws<tuft::exception>([&] { tuft::deserialize(good.substr(0, good.size() - 1)); }, "truncated template");
+    }
+
+    /** @brief Every byte of a template replaced by a few values that tend to break things */
+    void flipped_bytes()
+    {
+        const tuft::string_t good = blob();
+
+        for (size_t i = 0; i < good.size(); ++i)
+        {
+            for (unsigned char value : {0x00, 0x01, 0x02, 0x04, 0x41, 0x7F, 0x80, 0xFF})
+            {
+                tuft::string_t data = good;
+                data[i] = static_cast<char>(value);
+                load_and_render(data);
+            }
+
+            tuft::string_t data = good;
+            data[i] = static_cast<char>(data[i] ^ 0x80);
+            load_and_render(data);
+        }
+    }
+}
+
+int main()
+{
+    invalid_fields();
+    flipped_bytes();
+
+    return tuft_test::result("deserialize");
+}
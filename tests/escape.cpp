@@ -0,0 +1,229 @@
+/*
+ * Copyright 2016 Charles Jared Jetsel
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the "Software"), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons
+ * to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+/**
+ * escape
+ *
+ * @brief   Checks the vectorized escape policies against plain one character at a time versions, for texts of many
+ *          lengths and alignments so that special characters land in every lane and in the scalar tail.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+
+#include "check.hpp"
+#include "tuft.hpp"
+
+namespace
+{
+    using tuft_test::check;
+
+    std::string code_unit(unsigned char c)
+    {
+        char sequence[8];
+        std::snprintf(sequence, sizeof(sequence), "\\u%04X", c);
+        return sequence;
+    }
+
+    std::string reference_html(const std::string& text)
+    {
+        std::string escaped;
+
+        for (char c : text)
+        {
+            switch (c)
+            {
+            case '&':  escaped += "&amp;";  break;
+            case '<':  escaped += "&lt;";   break;
+            case '>':  escaped += "&gt;";   break;
+            case '"':  escaped += "&quot;"; break;
+            case '\'': escaped += "&#39;";  break;
+            case '/':  escaped += "&#x2F;"; break;
+            default:   escaped += c;        break;
+            }
+        }
+
+        return escaped;
+    }
+
+    std::string reference_json(const std::string& text, bool js)
+    {
+        std::string escaped;
+
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            const unsigned char c = static_cast<unsigned char>(text[i]);
+
+            if (js && text.compare(i, 3, "\xE2\x80\xA8") == 0)
+            {
+                escaped += "\\u2028";
+                i += 2;
+            }
+            else if (js && text.compare(i, 3, "\xE2\x80\xA9") == 0)
+            {
+                escaped += "\\u2029";
+                i += 2;
+            }
+            else if (js && c == '\'')
+                escaped += "\\'";
+            else if (js && (c == '<' || c == '>' || c == '&'))
+                escaped += code_unit(c);
+            else if (c == '"')
+                escaped += "\\\"";
+            else if (c == '\\')
+                escaped += "\\\\";
+            else if (c == '\b')
+                escaped += "\\b";
+            else if (c == '\f')
+                escaped += "\\f";
+            else if (c == '\n')
+                escaped += "\\n";
+            else if (c == '\r')
+                escaped += "\\r";
+            else if (c == '\t')
+                escaped += "\\t";
+            else if (c < 0x20)
+                escaped += code_unit(c);
+            else
+                escaped += static_cast<char>(c);
+        }
+
+        return escaped;
+    }
+
+    std::string reference_url(const std::string& text)
+    {
+        std::string escaped;
+
+        for (char ch : text)
+        {
+            const unsigned char c = static_cast<unsigned char>(ch);
+            const bool unreserved = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                                    c == '-' || c == '_' || c == '.' || c == '~';
+
+            if (unreserved)
+            {
+                escaped += ch;
+            }
+            else
+            {
+                char sequence[4];
+                std::snprintf(sequence, sizeof(sequence), "%%%02X", c);
+                escaped += sequence;
+            }
+        }
+
+        return escaped;
+    }
+
+    template <typename Escape>
+    std::string escape(const std::string& text)
+    {
+        std::string escaped;
+        Escape::escape(escaped, text);
+        return escaped;
+    }
+
+    /** @brief Texts made of pieces that are special to one escaper or another, including bytes >= 0x80 */
+    void random_texts()
+    {
+        const char* pieces[] = { "a", "Z", "0", "-", "~", ".", "_", " ", "%", "+", "/", "&", "<", ">", "\"", "'", "\\",
+                                 "\n", "\r", "\t", "\b", "\f", "\x01", "\x1F", "\x7F", "\xFF", "\xE2\x80\xA8",
+                                 "\xE2\x80\xA9", "\xE2\x82\xAC", "\xE2\x80", "\xE2", "\xC3\xA9" };
+
+        std::mt19937 random(2016);
+        bool ok = true;
+
+        for (int round = 0; round < 2000 && ok; ++round)
+        {
+            std::string padded;
+            const size_t count = random() % 100;
+
+            for (size_t i = 0; i < count; ++i)
+                padded += pieces[random() % (sizeof(pieces) / sizeof(pieces[0]))];
+
+            // Every suffix starts at another alignment and moves the special characters to other lanes
+            for (size_t offset = 0; offset < std::min<size_t>(padded.size(), 33) && ok; ++offset)
+            {
+                const std::string text = padded.substr(offset);
+
+                ok = escape<tuft::html_escape>(text) == reference_html(text) &&
+                     escape<tuft::json_escape>(text) == reference_json(text, false) &&
+                     escape<tuft::js_escape>(text)   == reference_json(text, true) &&
+                     escape<tuft::url_escape>(text)  == reference_url(text);
+            }
+        }
+
+        check(ok, "vectorized escapers match the reference");
+    }
+
+    /** @brief Each special character at every position of a text longer than two AVX2 blocks */
+    void every_position()
+    {
+        const std::string specials[] = { "&", "<", ">", "\"", "'", "/", "\\", "\n", "\x1F", " ", "\xE2\x80\xA8", "\xE2\x80\xA9" };
+        bool ok = true;
+
+        for (const auto& special : specials)
+        {
+            for (size_t at = 0; at <= 70; ++at)
+            {
+                std::string text(70, 'x');
+                text.insert(at, special);
+
+                ok = ok && escape<tuft::html_escape>(text) == reference_html(text) &&
+                           escape<tuft::json_escape>(text) == reference_json(text, false) &&
+                           escape<tuft::js_escape>(text)   == reference_json(text, true) &&
+                           escape<tuft::url_escape>(text)  == reference_url(text);
+            }
+        }
+
+        check(ok, "special characters are found at every position");
+    }
+
+    void rendered()
+    {
+        tuft::options_t options;
+
+        options.escape = tuft::escape_t::url;
+        check(tuft::render("?n={{n}}&q={{q}}", {{"n", 1e21}, {"q", "a b"}}, options) == "?n=1e%2B21&q=a%20b", "numbers are url escaped");
+
+        options.escape = tuft::escape_t::js;
+        check(tuft::render("'{{s}}'", {{"s", "\xE2\x80\xA8</script>\xE2\x80\xA9"}}, options) == "'\\u2028\\u003C/script\\u003E\\u2029'",
+              "line and paragraph separators are js escaped");
+
+        options.escape = tuft::escape_t::json;
+        check(tuft::render("\"{{s}}\"", {{"s", "\x01\t\""}}, options) == "\"\\u0001\\t\\\"\"", "control characters are json escaped");
+
+        check(tuft::render("{{s}}", {{"s", "<a href='/'>"}}) == "&lt;a href=&#39;&#x2F;&#39;&gt;", "html is escaped by default");
+    }
+}
+
+int main()
+{
+    random_texts();
+    every_position();
+    rendered();
+
+    return tuft_test::result("escape");
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2016 Charles Jared Jetsel
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the "Software"), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons
+ * to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * parallel
+ *
+ * @brief   Checks that parallel rendering gives byte for byte the output of a serial render
+ */
+
+#include "check.hpp"
+#include "tuft.hpp"
+#include "tuft_parallel.hpp"
+
+namespace
+{
+    using tuft_test::check;
+
+    tuft::json_t make_rows(int count)
+    {
+        tuft::json_t rows = tuft::json_t::array();
+
+        for (int i = 0; i < count; ++i)
+        {
+            tuft::json_t cells = tuft::json_t::array();
+
+            for (int c = 0; c < i % 5; ++c)
+                cells.push_back(c * i);
+
+            rows.push_back({{"id", i}, {"name", "row <" + std::to_string(i) + ">"}, {"cells", cells}, {"odd", i % 2 == 1}});
+        }
+
+        return rows;
+    }
+
+    /** @brief Renders with every combination of pool size and chunking, small enough that most sections are split */
+    void compare(const tuft::compiled_template& compiled, const tuft::json_t& hash, const char* what)
+    {
+        const tuft::string_t serial = tuft::render(compiled, hash);
+
+        for (size_t threads : {1, 2, 4})
+        {
+            tuft::thread_pool pool(threads);
+
+            for (size_t min_elements : {1, 3, 100})
+            {
+                for (size_t chunk_elements : {0, 1, 2, 7, 64})
+                {
+                    tuft::parallel_options_t options;
+                    options.min_elements   = min_elements;
+                    options.chunk_elements = chunk_elements;
+
+                    check(tuft::render(compiled, hash, pool, options) == serial, what);
+
+                    tuft::string_t appended = "prefix";
+                    tuft::render_append(appended, compiled, hash, pool, options);
+                    check(appended == "prefix" + serial, what);
+                }
+            }
+        }
+    }
+
+    void nested_arrays()
+    {
+        const auto compiled = tuft::compile("<table>{{#rows}}<tr id=\"{{id}}\"><td>{{name}}</td>{{#cells}}<td>{{.}}</td>{{/cells}}"
+                                            "{{^cells}}<td>empty</td>{{/cells}}{{#odd}}<td>odd</td>{{/odd}}</tr>{{/rows}}</table>");
+
+        compare(compiled, {{"rows", make_rows(300)}}, "nested arrays render differently in parallel");
+        compare(compiled, {{"rows", tuft::json_t::array()}}, "empty array renders differently in parallel");
+    }
+
+    void top_level_array()
+    {
+        const auto compiled = tuft::compile("<p>{{id}} {{name}}</p>{{#cells}}[{{.}}]{{/cells}}\n");
+        compare(compiled, make_rows(250), "top level array renders differently in parallel");
+    }
+
+    void escape_policies()
+    {
+        tuft::options_t options;
+        options.escape = tuft::escape_t::url;
+
+        const auto compiled = tuft::compile("{{#rows}}{{name}}&{{/rows}}", options);
+        compare(compiled, {{"rows", make_rows(100)}}, "url escaped section renders differently in parallel");
+    }
+
+    void batch()
+    {
+        const auto compiled = tuft::compile("<p>{{name}}</p>{{#cells}}{{.}},{{/cells}}");
+        const tuft::json_t rows = make_rows(500);
+
+        std::vector<tuft::json_t> contexts(rows.begin(), rows.end());
+        tuft::thread_pool pool(3);
+
+        const auto pages = tuft::render_batch(compiled, contexts, pool);
+        bool same = pages.size() == contexts.size();
+
+        for (size_t i = 0; same && i < pages.size(); ++i)
+            same = pages[i] == tuft::render(compiled, contexts[i]);
+
+        check(same, "render_batch renders differently or out of order");
+    }
+}
+
+int main()
+{
+    nested_arrays();
+    top_level_array();
+    escape_policies();
+    batch();
+
+    return tuft_test::result("parallel");
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2016 Charles Jared Jetsel
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the "Software"), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons
+ * to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * tuftc_output
+ *
+ * @brief   Checks that the render functions tuftc generates through cmake/tuftc.cmake give the same output as tuft::render()
+ */
+
+#include <fstream>
+#include <sstream>
+
+#include "check.hpp"
+#include "tuft.hpp"
+
+#include "page.hpp"
+#include "listing.hpp"
+
+namespace
+{
+    using tuft_test::check;
+
+    tuft::template_t read_template(const char* name)
+    {
+        std::ifstream in(tuft::string_t(TUFT_TEST_TEMPLATES) + "/" + name, std::ios::binary);
+        std::ostringstream text;
+        text << in.rdbuf();
+
+        return text.str();
+    }
+
+    const tuft::json_t contexts[] = {
+        tuft::json_t::parse(R"({
+            "title": "People & <friends>",
+            "people": [
+                { "name": "Albert", "age": 41, "admin": true, "bio": "<b>\"quoted\"</b>" },
+                { "name": "Bernard   line", "age": 2.5, "admin": false, "bio": null },
+                { "name": "Catheline", "age": -7 }
+            ],
+            "tags": ["a", 1, true, null, {"k": "v"}],
+            "score": 1e21,
+            "nested": {"a": [1, 2]}
+        })"),
+        tuft::json_t::parse(R"({ "title": "Empty", "people": [], "tags": [] })"),
+        tuft::json_t::parse(R"([{ "title": "First" }, { "title": "Second", "people": [{ "name": "x" }] }])"),
+        tuft::json_t::parse(R"({})"),
+    };
+}
+
+int main()
+{
+    const auto page = tuft::compile(read_template("page.mustache"));
+
+    tuft::options_t listing_options("<%", "%>");
+    listing_options.escape = tuft::escape_t::json;
+    const auto listing = tuft::compile(read_template("listing.mustache"), listing_options);
+
+    for (const auto& context : contexts)
+    {
+        check(templates::render_page(context) == tuft::render(page, context), "generated page differs from tuft::render()");
+        check(templates::render_listing(context) == tuft::render(listing, context), "generated listing differs from tuft::render()");
+    }
+
+    return tuft_test::result("tuftc_output");
+}
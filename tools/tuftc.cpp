@@ -0,0 +1,317 @@
+/*
+ * Copyright 2016 Charles Jared Jetsel
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the "Software"), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons
+ * to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * tuftc
+ *
+ * @brief   Compiles a mustache template into a C++ header with a render function specialized for it
+ *
+ * Usage:   tuftc <input.mustache> <output.hpp> [--name NAME] [--namespace NS] [--open DELIM] [--close DELIM]
+ *                [--escape html|none|json|url|js]
+ *
+ * The header declares, in namespace NS (default "templates"):
+ *
+ *      template <typename Output> void render_NAME(Output& out, const tuft::json_t& hash);
+ *      tuft::string_t render_NAME(const tuft::json_t& hash);
+ *
+ * Literals become constant string views and tags become direct lookups and appends, so the output is the
+ * same as tuft::render() without interpreting the template at runtime. NAME defaults to the file name.
+ */
+
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "../tuft.hpp"
+
+namespace
+{
+    using tuft::string_t;
+    using tuft::string_view_t;
+    using tuft::detail::node;
+    using tuft::detail::node_type;
+
+    /** @return Text as a C++ string literal. Every byte that isn't plain printable ASCII is an octal escape. */
+    string_t quote(string_view_t text)
+    {
+        string_t quoted = "\"";
+
+        for (unsigned char c : text)
+        {
+            switch (c)
+            {
+            case '"':  quoted += "\\\""; break;
+            case '\\': quoted += "\\\\"; break;
+            case '\n': quoted += "\\n";  break;
+            case '\t': quoted += "\\t";  break;
+            case '?':  quoted += "\\?";  break; // no trigraphs
+            default:
+                if (c >= 0x20 && c < 0x7F)
+                {
+                    quoted += static_cast<char>(c);
+                }
+                else
+                {
+                    char octal[5];
+                    std::snprintf(octal, sizeof(octal), "\\%03o", c);
+                    quoted += octal;
+                }
+                break;
+            }
+        }
+
+        return quoted + "\"";
+    }
+
+    /** @return Text as a tuft::string_view_t expression, with its size so embedded nulls survive */
+    string_t view(string_view_t text)
+    {
+        return "tuft::string_view_t(" + quote(text) + ", " + std::to_string(text.size()) + ")";
+    }
+
+    /** @return Name of the escape policy type that options_t::escape selects */
+    string_t escape_policy(tuft::escape_t escape)
+    {
+        switch (escape)
+        {
+            case tuft::escape_t::none: return "tuft::no_escape";
+            case tuft::escape_t::json: return "tuft::json_escape";
+            case tuft::escape_t::url:  return "tuft::url_escape";
+            case tuft::escape_t::js:   return "tuft::js_escape";
+            case tuft::escape_t::html:
+            default:                   return "tuft::html_escape";
+        }
+    }
+
+    /** @return Identifier made from a file name, e.g. "product-list" becomes "product_list" */
+    string_t identifier(string_view_t name)
+    {
+        string_t id;
+
+        for (char c : name)
+            id += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+
+        if (id.empty() || std::isdigit(static_cast<unsigned char>(id[0])))
+            id.insert(0, "_");
+
+        return id;
+    }
+
+    class generator
+    {
+    public:
+        explicit generator(const tuft::compiled_template& compiled) : compiled_(compiled) {}
+
+        /** @brief Writes the statements that render nodes [first, last) with the context variable at depth */
+        void emit(size_t first, size_t last, size_t depth)
+        {
+            const auto nodes = compiled_.nodes();
+
+            for (size_t n = first; n < last; ++n)
+            {
+                const node& tag = nodes[n];
+                const string_t indent(12 * (depth + 1), ' ');
+                const string_t ctx = "ctx" + std::to_string(depth);
+
+                switch (tag.type)
+                {
+                    case node_type::literal:
+                        body_ << indent << "out.append(" << literal(compiled_.text(tag)) << ".data(), " << tag.length << ");\n";
+                        break;
+
+                    case node_type::variable:
+                        body_ << indent << "if (const tuft::json_t* value = tuft::detail::find_value(" << ctx << ", "
+                              << view(compiled_.text(tag)) << ", " << (tag.implicit ? "true" : "false") << "))\n"
+                              << indent << "    tuft::detail::append_value<" << escape_policy(compiled_.options().escape) << ">(out, *value, "
+                              << (tag.escape ? "true" : "false") << ");\n";
+                        break;
+
+                    case node_type::section:
+                    case node_type::inverted_section:
+                    {
+                        const string_t section = "section" + std::to_string(depth + 1);
+                        const bool inverted = tag.type == node_type::inverted_section;
+
+                        body_ << indent << "{\n"
+                              << indent << "    const tuft::json_t& " << section << " = tuft::detail::find_section(" << ctx << ", " << view(compiled_.text(tag)) << ");\n\n"
+                              << indent << "    if (tuft::detail::is_section_rendered(" << section << ", " << (inverted ? "true" : "false") << "))\n"
+                              << indent << "    {\n"
+                              << indent << "        tuft::detail::for_each_element(" << section << ", [&]([[maybe_unused]] const tuft::json_t& ctx" << depth + 1 << ")\n"
+                              << indent << "        {\n";
+
+                        emit(n + 1, tag.end, depth + 1);
+
+                        body_ << indent << "        });\n"
+                              << indent << "    }\n"
+                              << indent << "}\n";
+
+                        // Move after section's closing tag for next round
+                        n = tag.end - 1;
+                        break;
+                    }
+                }
+            }
+        }
+
+        /** @brief Writes the whole header */
+        void write(std::ostream& os, const string_t& input, const string_t& ns, const string_t& name)
+        {
+            emit(0, compiled_.nodes().size(), 0);
+
+            os << "// Generated by tuftc from " << input << ". Do not edit.\n"
+               << "#pragma once\n\n"
+               << "#include \"tuft.hpp\"\n\n"
+               << "namespace " << ns << "\n{\n"
+               << "    namespace " << name << "_literals\n    {\n"
+               << literals_.str()
+               << "    }\n\n"
+               << "    template <typename Output>\n"
+               << "    void render_" << name << "(Output& out, const tuft::json_t& hash)\n"
+               << "    {\n"
+               << "        using namespace " << name << "_literals;\n\n"
+               << "        // Like tuft::render(), a top level array renders the template once per element\n"
+               << "        tuft::detail::for_each_element(hash, [&]([[maybe_unused]] const tuft::json_t& ctx0)\n"
+               << "        {\n"
+               << body_.str()
+               << "        });\n"
+               << "    }\n\n"
+               << "    inline tuft::string_t render_" << name << "(const tuft::json_t& hash)\n"
+               << "    {\n"
+               << "        tuft::string_t out;\n"
+               << "        out.reserve(" << compiled_.source().size() << ");\n"
+               << "        render_" << name << "(out, hash);\n\n"
+               << "        return out;\n"
+               << "    }\n"
+               << "}\n";
+        }
+
+    private:
+        /** @return Name of a new constant holding the literal text */
+        string_t literal(string_view_t text)
+        {
+            const string_t name = "literal" + std::to_string(literal_count_++);
+            literals_ << "        constexpr tuft::string_view_t " << name << " = " << view(text) << ";\n";
+
+            return name;
+        }
+
+        const tuft::compiled_template& compiled_;
+        std::ostringstream literals_;
+        std::ostringstream body_;
+        size_t literal_count_ = 0;
+    };
+
+    int usage()
+    {
+        std::cerr << "usage: tuftc <input.mustache> <output.hpp> [--name NAME] [--namespace NS] [--open DELIM] [--close DELIM]"
+                     " [--escape html|none|json|url|js]\n";
+        return 2;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+        return usage();
+
+    const string_t input  = argv[1];
+    const string_t output = argv[2];
+
+    string_t ns = "templates";
+    string_t name;
+    tuft::options_t options;
+
+    for (int i = 3; i + 1 < argc; i += 2)
+    {
+        const string_t flag = argv[i];
+
+        if (flag == "--name")
+            name = argv[i + 1];
+        else if (flag == "--namespace")
+            ns = argv[i + 1];
+        else if (flag == "--open")
+            options.delim_open = argv[i + 1];
+        else if (flag == "--close")
+            options.delim_close = argv[i + 1];
+        else if (flag == "--escape")
+        {
+            const string_t escape = argv[i + 1];
+
+            if (escape == "html")
+                options.escape = tuft::escape_t::html;
+            else if (escape == "none")
+                options.escape = tuft::escape_t::none;
+            else if (escape == "json")
+                options.escape = tuft::escape_t::json;
+            else if (escape == "url")
+                options.escape = tuft::escape_t::url;
+            else if (escape == "js")
+                options.escape = tuft::escape_t::js;
+            else
+                return usage();
+        }
+        else
+            return usage();
+    }
+
+    if (name.empty())
+    {
+        auto slash = input.find_last_of("/\\");
+        name = input.substr(slash == string_t::npos ? 0 : slash + 1);
+        name = name.substr(0, name.find('.'));
+    }
+
+    std::ifstream in(input, std::ios::binary);
+
+    if (!in)
+    {
+        std::cerr << "tuftc: could not open '" << input << "'\n";
+        return 1;
+    }
+
+    std::ostringstream text;
+    text << in.rdbuf();
+
+    try
+    {
+        const auto compiled = tuft::compile(text.str(), options);
+
+        std::ostringstream header;
+        generator(compiled).write(header, input, ns, identifier(name));
+
+        std::ofstream out(output, std::ios::binary | std::ios::trunc);
+        out << header.str();
+
+        if (!out)
+        {
+            std::cerr << "tuftc: could not write '" << output << "'\n";
+            return 1;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "tuftc: " << input << ": " << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
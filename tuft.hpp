@@ -21,18 +21,88 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <exception>
+#include <functional>
+#include <limits>
+#include <list>
+#include <memory>
+#if __has_include(<memory_resource>)
+    #include <memory_resource>
+#endif
+#include <mutex>
+#include <shared_mutex>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
 
 #include <nlohmann/json.hpp>
 
+// Define TUFT_NO_SIMD to use only the portable scalar code paths
+#if !defined(TUFT_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+    #define TUFT_SSE2 1
+    #include <emmintrin.h>
+
+    #if defined(_MSC_VER) && !defined(__clang__)
+        #include <intrin.h>
+    #endif
+
+    // AVX2 is selected at runtime so the header doesn't have to be built with -mavx2
+    #if defined(__GNUC__) || defined(__clang__)
+        #define TUFT_AVX2 1
+        #include <immintrin.h>
+    #endif
+#endif
+
+// Labels as values let the renderer jump straight to the code for the next node
+#if !defined(TUFT_NO_COMPUTED_GOTO) && (defined(__GNUC__) || defined(__clang__))
+    #define TUFT_COMPUTED_GOTO 1
+#endif
+
+// Templates parsed at compile time need class types as template arguments and consteval (C++20)
+#if defined(__cpp_consteval) && defined(__cpp_nontype_template_args) && __cpp_nontype_template_args >= 201911L
+    #define TUFT_STATIC_TEMPLATES 1
+#endif
+
+// Polymorphic allocators let a render use a caller's memory resource, e.g. an arena per request
+#if defined(__cpp_lib_memory_resource)
+    #define TUFT_PMR 1
+#endif
+
 namespace tuft
 {
     /** @brief  String containing mustache template */
-    using string_t   = std::string;
-    using template_t = string_t;
-    using json_t     = nlohmann::json;
+    using string_t      = std::string;
+    using template_t    = string_t;
+    using string_view_t = std::string_view;
+    using json_t        = nlohmann::json;
     
+    /** @brief  Escape policies that options_t can select at runtime */
+    enum class escape_t : uint8_t
+    {
+        /** Special html characters become entities */
+        html = 0,
+
+        /** Values are appended as they are */
+        none,
+
+        /** Values are escaped for the inside of a JSON string */
+        json,
+
+        /** Values are percent encoded as a URL component */
+        url,
+
+        /** Values are escaped for the inside of a JavaScript string in an inline script */
+        js,
+    };
+
     /**
      * options_t
      *
@@ -50,6 +120,12 @@ namespace tuft
 
         /** Closing delimiter. Default is "}}" */
         string_t delim_close = "}}";
+
+        /** Maximum number of nested sections. Deeper templates fail with tuft::exception instead of rendering. Default is 1024 */
+        size_t max_depth = 1024;
+
+        /** How variables are escaped. Triple mustache and ampersand tags are never escaped. Default is html */
+        escape_t escape = escape_t::html;
     };
 
     /** @brief  Exception type that is thrown from tuft */
@@ -68,11 +144,205 @@ namespace tuft
      * @param   options Configuration
      * @return
      */
-    string_t render(const template_t & templ, const json_t & hash, const options_t options = options_t());
+    inline string_t render(const template_t & templ, const json_t & hash, const options_t options = options_t());
+
+    class compiled_template;
+
+#if TUFT_STATIC_TEMPLATES
+    /**
+     * fixed_string
+     *
+     * @brief   String literal that can be a template argument, e.g. the template of tuft::render<"Hello {{name}}">()
+     */
+    template <size_t N>
+    struct fixed_string
+    {
+        constexpr fixed_string(const char (&s)[N])
+        {
+            for (size_t i = 0; i < N; ++i)
+                data[i] = s[i];
+        }
+
+        /** @brief Size without the terminating null */
+        static constexpr size_t size() { return N - 1; }
+
+        constexpr string_view_t view() const { return string_view_t(data, N - 1); }
+
+        char data[N] {};
+    };
+
+    template <size_t NodeCount, size_t TextSize, fixed_string Open, fixed_string Close>
+    class static_template;
+#endif
+
+    /**
+     * compile
+     * @brief   Tokenizes a mustache template once so that it can be rendered many times
+     *
+     * @param   templ   Mustache template string
+     * @param   options Configuration
+     * @return  Immutable compiled template. It is safe to render it concurrently from several threads.
+     */
+    inline compiled_template compile(const template_t & templ, const options_t options = options_t());
+
+#if TUFT_PMR
+    /**
+     * compile
+     * @brief   Tokenizes a mustache template with its text and nodes allocated from a memory resource
+     *
+     * @param   templ       Mustache template string
+     * @param   options     Configuration
+     * @param   resource    Memory resource for the compiled template and the tokenizer's scratch state. It must outlive the template.
+     * @return  Immutable compiled template
+     */
+    inline compiled_template compile(const template_t & templ, const options_t options, std::pmr::memory_resource* resource);
+#endif
+
+    /**
+     * serialize
+     * @brief   Writes a compiled template in tuft's versioned binary format
+     *
+     * @param   compiled    Template returned from tuft::compile()
+     * @return  Bytes that tuft::deserialize() can use without parsing the template again
+     */
+    inline string_t serialize(const compiled_template & compiled);
+
+    /**
+     * deserialize
+     * @brief   Loads a compiled template from the output of tuft::serialize()
+     *
+     * @param   data    Serialized template, e.g. a part of a mapped file
+     * @param   owner   Keeps data alive. The template uses data in place, no node is copied or allocated.
+     *                  If it is null, or data isn't aligned for the nodes, data is copied once instead.
+     * @return  Compiled template
+     *
+     * @throw   tuft::exception if data isn't a valid serialized template of this version
+     */
+    inline compiled_template deserialize(string_view_t data, std::shared_ptr<const void> owner = nullptr);
+
+    /**
+     * render
+     * @brief   Renders hash/json values into a compiled template
+     *
+     * @param   compiled    Template returned from tuft::compile()
+     * @param   hash        JSON object
+     * @return
+     */
+    inline string_t render(const compiled_template & compiled, const json_t & hash);
+
+    /**
+     * render_into
+     * @brief   Renders hash/json values into a compiled template, replacing the contents of a caller owned string
+     *
+     * @param   out         Output string. Its capacity is kept so a buffer that is reused stops reallocating.
+     * @param   compiled    Template returned from tuft::compile()
+     * @param   hash        JSON object
+     */
+    inline void render_into(string_t & out, const compiled_template & compiled, const json_t & hash);
+
+    /**
+     * render_into
+     * @brief   Renders hash/json values into mustache template, replacing the contents of a caller owned string
+     *
+     * @param   out     Output string. Its capacity is kept so a buffer that is reused stops reallocating.
+     * @param   templ   Mustache template string
+     * @param   hash    JSON object
+     * @param   options Configuration
+     */
+    inline void render_into(string_t & out, const template_t & templ, const json_t & hash, const options_t options = options_t());
+
+    /**
+     * render_append
+     * @brief   Renders hash/json values into a compiled template and appends the output to a caller owned string
+     *
+     * @param   out         Output string
+     * @param   compiled    Template returned from tuft::compile()
+     * @param   hash        JSON object
+     */
+    inline void render_append(string_t & out, const compiled_template & compiled, const json_t & hash);
+
+    /**
+     * render_append
+     * @brief   Renders hash/json values into mustache template and appends the output to a caller owned string
+     *
+     * @param   out     Output string
+     * @param   templ   Mustache template string
+     * @param   hash    JSON object
+     * @param   options Configuration
+     */
+    inline void render_append(string_t & out, const template_t & templ, const json_t & hash, const options_t options = options_t());
+
+    /**
+     * rendered_size
+     * @brief   Computes the exact size of the output without rendering it
+     *
+     * @param   compiled    Template returned from tuft::compile()
+     * @param   hash        JSON object
+     * @return  Number of characters that render() would output, e.g. to reserve a buffer for render_append()
+     */
+    inline size_t rendered_size(const compiled_template & compiled, const json_t & hash);
+
+    /**
+     * render_result
+     *
+     * @brief   Outcome of tuft::render_to()
+     */
+    struct render_result
+    {
+        /** Characters written to the buffer, without the terminating null */
+        size_t written = 0;
+
+        /** Size of the whole output, without the terminating null. A buffer of size + 1 characters holds all of it. */
+        size_t size = 0;
+
+        /** @return True if the output didn't fit into the buffer */
+        bool truncated() const { return size > written; }
+    };
+
+    /**
+     * render_to
+     * @brief   Renders hash/json values into a compiled template in a caller provided buffer, like snprintf
+     *
+     * @param   buffer      Output buffer. The output is cut off at capacity - 1 characters and always null terminated.
+     *                      If rendering throws, buffer holds an empty string.
+     * @param   capacity    Size of buffer, may be 0
+     * @param   compiled    Template returned from tuft::compile()
+     * @param   hash        JSON object
+     * @return  Characters written and the size the whole output needs
+     *
+     * @note    Nothing is allocated, unless sections are nested more than 16 deep or a variable is an object or an array,
+     *          which nlohmann::json dumps into a temporary string.
+     */
+    inline render_result render_to(char* buffer, size_t capacity, const compiled_template & compiled, const json_t & hash);
+
+#if TUFT_PMR
+    /**
+     * render
+     * @brief   Renders hash/json values into a compiled template with the output and scratch state allocated from a memory resource
+     *
+     * @param   compiled    Template returned from tuft::compile()
+     * @param   hash        JSON object
+     * @param   resource    Memory resource, e.g. a std::pmr::monotonic_buffer_resource that is released when a request ends
+     * @return
+     */
+    inline std::pmr::string render(const compiled_template & compiled, const json_t & hash, std::pmr::memory_resource* resource);
+
+    /**
+     * render
+     * @brief   Renders hash/json values into mustache template with all memory allocated from a memory resource
+     *
+     * @param   templ       Mustache template string
+     * @param   hash        JSON object
+     * @param   resource    Memory resource for the output, the compiled template and scratch state
+     * @param   options     Configuration
+     * @return
+     */
+    inline std::pmr::string render(const template_t & templ, const json_t & hash, std::pmr::memory_resource* resource, const options_t options = options_t());
+#endif
 
     namespace detail
     {
-        using std::distance, std::next, std::search;
+        using std::distance, std::next;
         using iter = string_t::const_iterator;
 
         /** @brief  Enumeration of symbol characters that represent a tag type */
@@ -99,377 +369,2885 @@ namespace tuft
             invalid = 0x0F,
         };
 
-        const string_t tag_type_symbols("&#^/!");
-        const string_t mustaches("{ }");
-        
+        /** @brief  Enumeration of the kinds of node in a compiled template */
+        enum class node_type : uint8_t
+        {
+            /** Text copied to the output as is. Comments are stored as literals too. */
+            literal = 0,
+
+            /** Variable tag, escaped or not */
+            variable,
+
+            /** Section tag beginning with '#' */
+            section,
+
+            /** Section tag beginning with '^' */
+            inverted_section,
+        };
+
         /**
-         * render_next
-         *
-         * @brief Renders the json elements and its descendants into the current range of the template
+         * node
          *
-         * @param begin         String iterator to the beginning of the remainder of the template string or current section
-         * @param end           String iterator to the end of the current section
-         * @param current_elem  Current json element that is being rendered
-         *
-         * @note  This is a recursive function.
+         * @brief   One literal segment or tag of a compiled template
          */
-        void render_next(const template_t& t, const iter& begin, const iter& end, string_t& rendered, const json_t& current_elem, const options_t& opts);
-    }
+        struct node
+        {
+            node_type type = node_type::literal;
 
-    string_t render(const template_t & t, const json_t & hash, options_t options)
-    {
-        string_t rendered;
+            /** Variables: true if the value is html escaped */
+            bool escape = true;
 
-        if (t.size() == 0)
-            return rendered;
+            /** Variables: true if the tag refers to the current element itself, i.e. "{{.}}" or "{{}}" */
+            bool implicit = false;
 
-        rendered.reserve(t.size()); // approx. tag names are removed so it should be fairly close
-        detail::render_next(t, t.begin(), t.end(), rendered, hash, options);
+            bool reserved = false;
 
-        return rendered;
-    }
+            /**
+             * Literals: position and size of the text. Variables and sections: position and size of the name.
+             * Both refer to the template's text, which is the source followed by any names that aren't a part of it.
+             */
+            uint32_t offset = 0;
+            uint32_t length = 0;
+
+            /** Sections: index of the node following the section's closing tag. The interior is [index + 1, end). */
+            uint32_t end = 0;
+
+            /** Sections: size of the literal text directly in the interior, which is rendered for every element. Nested sections aren't counted. */
+            uint32_t literal_length = 0;
+        };
+
+        static_assert(std::is_trivially_copyable<node>::value && sizeof(node) == 20, "Nodes are serialized as is");
 
-    namespace detail
-    {
         /**
-         * find_next_tag
-         *
-         * @param   b   Beginning of range to search for tag
-         * @param   e   End of range to search for tag
-         *
-         * @param   tag_begin  Out: Iterator to the beginning of the tag before delimiters
-         * @param   tag_end    Out: Iterator to the end of the tag after delimiters
-         *
-         * @return  true if next tag/section is found
+         * blob_header
          *
-         * @note    Output iters will be equal to e if not found.
+         * @brief   Start of a serialized template. It is followed by the nodes, the text and the delimiters.
          */
-        bool find_next_tag(const iter& b, const iter& e, iter& tag_begin, iter& tag_end, const options_t& opts)
+        struct blob_header
         {
-            tag_begin = e;
-            tag_end = e;
-            tag_begin = search(b, e, opts.delim_open.begin(), opts.delim_open.end());
-
-            string_t delim_close = opts.delim_close;
+            char     magic[4];
+            uint16_t version;
+            uint16_t byte_order;
+            uint32_t node_count;
+            uint32_t text_size;
+            uint32_t source_size;
+            uint32_t delim_open_size;
+            uint32_t delim_close_size;
+            uint32_t max_depth; // Clamped, the largest value reads back as no limit
+            uint32_t escape;
+        };
 
-            // Special case for triple mustache escape.
-            if (opts.delim_open == "{{" && opts.delim_close == "}}")
-            {
-                string_t triple_open = "{{{";
+        const char     blob_magic[4]   = { 'T', 'U', 'F', 'T' };
+        const uint16_t blob_version    = 3;
+        const uint16_t blob_byte_order = 0x0102; // Reads back differently on a host with the other byte order
 
-                auto triple_begin  = search(b, e, triple_open.begin(), triple_open.end());
+        /**
+         * node_span
+         *
+         * @brief   Contiguous nodes that are owned elsewhere
+         */
+        struct node_span
+        {
+            const node* first = nullptr;
+            size_t count = 0;
 
-                if (tag_begin == triple_begin)
-                    delim_close = "}}}";
-            }
+            const node* begin() const { return first; }
+            const node* end() const { return first + count; }
+            size_t size() const { return count; }
+            const node& operator[](size_t i) const { return first[i]; }
+        };
 
-            if (tag_begin != e)
-            {
-                auto after_tag_begin = next(tag_begin, opts.delim_open.size());
+        /**
+         * basic_template_storage
+         *
+         * @brief   Text and nodes of a template compiled in this process, allocated with Allocator
+         */
+        template <typename Allocator>
+        struct basic_template_storage
+        {
+            /** Allocator of the storage rebound to T, for the scratch state of the tokenizer */
+            template <typename T>
+            using rebind_t = typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
 
-                tag_end = search(after_tag_begin, e, delim_close.begin(), delim_close.end());
+            explicit basic_template_storage(const Allocator& alloc = Allocator()) : text(alloc), nodes(alloc) {}
 
-                if (tag_end != e)
-                    tag_end = next(tag_end, delim_close.size()); // move after end delimiter
-            }
+            std::basic_string<char, std::char_traits<char>, Allocator> text;
+            std::vector<node, rebind_t<node>> nodes;
+        };
 
-            return (tag_begin != tag_end);
-        }
+        using template_storage = basic_template_storage<std::allocator<char>>;
 
         /**
-         * inside_tag
+         * mustache_delimiters
          *
-         * @param b Iterator pointing to beginning of tag before starting delimiter
-         * @param e Iterator pointing to end of tag after ending delimiter
-         *
-         * @return  Pair of begin/end iterators pointing to the interior of the tag between delimiters
+         * @brief   Default "{{" and "}}" delimiters as constants, so tags are found with fixed width compares
          */
-        std::pair<iter, iter> inside_tag(const iter& b, const iter& e, const options_t& opts)
+        struct mustache_delimiters
         {
-            auto inside_begin = next(b,  opts.delim_open.size());  // after  "{{"
-            auto inside_end   = next(e, -opts.delim_close.size()); // before "}}"
+            static constexpr bool triple_mustache = true;
 
-            return std::make_pair(inside_begin, inside_end);
-        }
+            static constexpr string_view_t open() { return "{{"; }
+            static constexpr string_view_t close() { return "}}"; }
+        };
 
         /**
-         * tag_name
-         *
-         * @brief   Remove symbols and spaces from tag iterior to get name
+         * custom_delimiters
          *
-         * @param b Iterator pointing to beginning of tag before starting delimiter
-         * @param e Iterator pointing to end of tag after ending delimiter
-         *
-         * @return  variable/section name of tag
+         * @brief   Delimiters from options_t. There is no triple mustache with them.
          */
-        string_t get_tag_name(const iter& b, const iter& e, const options_t& opts)
+        struct custom_delimiters
         {
-            using std::remove_if;
-            
-            if (b == e)
-                return "";
+            static constexpr bool triple_mustache = false;
 
-            auto inside = inside_tag(b, e, opts);
-            string_t name(inside.first, inside.second);
+            string_view_t open_;
+            string_view_t close_;
 
-            name.erase(remove_if(name.begin(), name.end(), [](const char& x)
-                    {
-                        return (tag_type_symbols.find(x) != string_t::npos) || (x == '{') || (x == '}');
-                    }),
-                    name.end());
-
-            return name;
-        }
+            string_view_t open() const { return open_; }
+            string_view_t close() const { return close_; }
+        };
 
         /**
-         * get_tag_type
+         * execute
          *
-         * @param b Iterator pointing to beginning of tag before starting delimiter
-         * @param e Iterator pointing to end of tag after ending delimiter
+         * @brief Renders the json element into a compiled template
          *
-         * @return  Tag type enum value
+         * @param rendered      Output that has an append(const char*, size_t) member, e.g. string_t or tuft::sink
+         * @param element       Json element that is being rendered. A top level array renders the template once per element.
          *
-         * @note    Assumes that the mustache symbol is the first character in the tag (after whitespace is removed)
+         * @note  The nodes are run as a linear instruction stream. Sections push a frame instead of recursing.
          */
-        tag_type get_tag_type(const iter& b, const iter& e, const options_t& opts)
-        {
-            auto inside = inside_tag(b, e, opts);
-            tag_type tag {tag_type::variable};
+        template <typename Escape, typename Output>
+        void execute(const compiled_template& ct, Output& rendered, const json_t& element);
 
-            if (inside.first == inside.second) // empty tag
-                return tag;
+        struct html_special;
+        struct json_special;
+        struct js_special;
+        struct url_special;
 
-            for (auto it = inside.first; it != inside.second; ++it)
-            {
-                if (tag_type_symbols.find(*it) != string_t::npos)
-                {
-                    tag = static_cast<tag_type>(*it);
-                    break;
-                }
-            }
+        template <typename Special, typename Output>
+        void escape_special(Output& rendered, string_view_t text);
 
-            return tag;
-        }
+        template <typename Output>
+        void reserve_output(Output& rendered, size_t size);
+
+        template <typename Char, typename Traits, typename Allocator>
+        void reserve_output(std::basic_string<Char, Traits, Allocator>& rendered, size_t size);
+
+        template <typename Storage>
+        void tokenize(const template_t& t, Storage& compiled, const options_t& opts);
+
+        template <typename Storage>
+        compiled_template make_compiled(const template_t& t, const options_t& opts, std::shared_ptr<Storage> storage);
 
         /**
-         * should_escape
+         * size_hint
          *
-         * @param b Iterator pointing to beginning of tag before starting delimiter
-         * @param e Iterator pointing to end of tag after ending delimiter
-         *
-         * @return  True if the tag's contents should be escaped of all special html chars
+         * @brief   Moving high-water mark of output sizes. It can be updated from several threads at once.
          */
-        bool should_escape(const iter& b, const iter& e, const options_t& opts)
+        class size_hint
         {
-            using std::distance;
-            bool escape = true;
+        public:
+            size_hint() = default;
+            size_hint(const size_hint& other) : size_(other.get()) {}
 
-            if (get_tag_type(b, e, opts) == tag_type::escaped)
+            size_hint& operator=(const size_hint& other)
             {
-                escape = false;
+                size_.store(other.get(), std::memory_order_relaxed);
+                return *this;
             }
-            else if (distance(b, e) >= 6)
+
+            size_t get() const { return size_.load(std::memory_order_relaxed); }
+
+            /** @note Concurrent updates may overwrite each other. Any of them is a good enough hint. */
+            void record(size_t size)
             {
-                // Special case for triple mustache. Inner mustaches are ignored if delim is not default.
-                string_t test(b, e);
-                string_t first_three(b, next(b, 3));
-                string_t last_three(next(e, -3), e);
+                size_t current = get();
 
-                if (first_three == "{{{" && last_three == "}}}")
-                {
-                    escape = false;
-                }
+                // Grow straight to a bigger size but shrink slowly, so one small render doesn't undo the reservation
+                size_t next = size >= current ? size : current - (current - size) / 8;
+
+                size_.store(next, std::memory_order_relaxed);
             }
 
-            return escape;
-        }
+        private:
+            std::atomic<size_t> size_ {0};
+        };
 
         /**
-         * escape_html
+         * size_counter
          *
-         * @return  String with special html characters escaped.
+         * @brief   Output that only counts the characters appended to it
          */
-        string_t escape_html(const string_t& html)
+        struct size_counter
         {
-            string_t escaped;
-            escaped.reserve(html.size());
-
-            for (auto it = html.begin(); it != html.end(); ++it)
-            {
-                switch (*it)
-                {
-                case '&':  escaped += "&amp;";  break;
-                case '<':  escaped += "&lt;";   break;
-                case '>':  escaped += "&gt;";   break;
-                case '"':  escaped += "&quot;"; break;
-                case '\'': escaped += "&#39;";  break;
-                case '/':  escaped += "&#x2F;"; break;
-                default:   escaped += *it;      break;
-                }
-            }
+            size_t size = 0;
 
-            return escaped;
-        }
+            void append(const char*, size_t count) { size += count; }
+        };
 
-        void render_section(const template_t& t, const iter& begin, const iter& end, string_t& rendered, const json_t& current_elem, const options_t& opts, bool is_inverted)
+        /**
+         * fixed_buffer
+         *
+         * @brief   Output that fills a caller's buffer and counts what doesn't fit
+         */
+        struct fixed_buffer
         {
-            bool render_interior = false;
+            char* data;
+            size_t capacity;
+            size_t size = 0;
 
-            switch (current_elem.type())
+            void append(const char* text, size_t count)
             {
-                case json_t::value_t::array:
-                case json_t::value_t::object:
-                    render_interior = true;
-                    break;
-
-                case json_t::value_t::boolean:
-                    render_interior = current_elem.get<bool>();
-                    break;
+                if (size < capacity)
+                    std::memcpy(data + size, text, std::min(count, capacity - size));
 
-                case json_t::value_t::discarded:
-                case json_t::value_t::null:
-                case json_t::value_t::number_float:
-                case json_t::value_t::number_integer:
-                case json_t::value_t::number_unsigned:
-                default:
-                    break;
+                size += count;
             }
+        };
+    }
 
-            if (is_inverted)
-                render_interior = !render_interior;
+    /**
+     * html_escape
+     *
+     * @brief   Escape policy that replaces special html characters in variables with entities. This is the default.
+     *
+     * @note    An escape policy is a type with a static escape(Output&, string_view_t) member template that appends
+     *          text to the output. It is a template parameter of the renderer, so the escaping is inlined.
+     *          Triple mustache and ampersand tags are never passed to it. A policy that never changes the text of
+     *          a number can say so with a static constexpr bool safe_numbers = true, then numbers skip it.
+     */
+    struct html_escape
+    {
+        static constexpr bool safe_numbers = true;
 
-            if (render_interior)
-                render_next(t, begin, end, rendered, current_elem, opts);
-        }
+        template <typename Output>
+        static void escape(Output& rendered, string_view_t text) { detail::escape_special<detail::html_special>(rendered, text); }
+    };
 
-        void render_next(const template_t& t, const iter& begin, const iter& end, string_t& rendered, const json_t& element, const options_t& opts)
-        {
-            using std::to_string;
+    /**
+     * no_escape
+     *
+     * @brief   Escape policy that appends variables as they are, e.g. for plain text output
+     */
+    struct no_escape
+    {
+        static constexpr bool safe_numbers = true;
 
-            // If it is an array then we'll need to loop through once for each element
-            const bool is_array = element.is_array();
-            size_t loop_count = 1;
+        template <typename Output>
+        static void escape(Output& rendered, string_view_t text) { rendered.append(text.data(), text.size()); }
+    };
 
-            if (is_array)
-                loop_count = element.size();
+    /**
+     * json_escape
+     *
+     * @brief   Escape policy for the inside of a JSON string. Quotes, backslashes and control characters are escaped.
+     */
+    struct json_escape
+    {
+        static constexpr bool safe_numbers = true;
 
-            for (size_t i = 0; i < loop_count; ++i)
-            {
-                iter remaining_begin = begin;
-                iter tag_begin  = end; // Before "{{"
-                iter tag_end    = end; // After  "}}"
+        template <typename Output>
+        static void escape(Output& rendered, string_view_t text) { detail::escape_special<detail::json_special>(rendered, text); }
+    };
 
-                const json_t& current_elem = is_array ? element[i] : element;
+    /**
+     * url_escape
+     *
+     * @brief   Escape policy for a URL component. Everything but letters, digits and "-_.~" is percent encoded.
+     */
+    struct url_escape
+    {
+        template <typename Output>
+        static void escape(Output& rendered, string_view_t text) { detail::escape_special<detail::url_special>(rendered, text); }
+    };
 
-                while (find_next_tag(remaining_begin, end, tag_begin, tag_end, opts))
-                {
-                    rendered.append(remaining_begin, tag_begin); // This is the stuff between tags. Leave it alone.
+    /**
+     * js_escape
+     *
+     * @brief   Escape policy for the inside of a JavaScript string in an inline script. On top of the JSON escapes,
+     *          quotes, "<", ">", "&", U+2028 and U+2029 are escaped so the value can't end the string or the script.
+     */
+    struct js_escape
+    {
+        static constexpr bool safe_numbers = true;
 
-                    auto name = get_tag_name(tag_begin, tag_end, opts);
-                    bool is_inverted_section = false;
+        template <typename Output>
+        static void escape(Output& rendered, string_view_t text) { detail::escape_special<detail::js_special>(rendered, text); }
+    };
 
-                    tag_type type = get_tag_type(tag_begin, tag_end, opts);
+    namespace detail
+    {
+        /**
+         * with_escape
+         *
+         * @brief   Calls f with the escape policy that options_t::escape selects, so the renderer is specialized for it
+         */
+        template <typename F>
+        void with_escape(escape_t escape, F&& f)
+        {
+            switch (escape)
+            {
+                case escape_t::none: f(no_escape()); break;
+                case escape_t::json: f(json_escape()); break;
+                case escape_t::url:  f(url_escape()); break;
+                case escape_t::js:   f(js_escape()); break;
+                case escape_t::html:
+                default:             f(html_escape()); break;
+            }
+        }
+    }
+
+    /**
+     * render
+     * @brief   Renders hash/json values into a compiled template with an escape policy, e.g. tuft::render<tuft::no_escape>(compiled, hash)
+     *
+     * @tparam  Escape      Escape policy, see html_escape
+     * @param   compiled    Template returned from tuft::compile()
+     * @param   hash        JSON object
+     * @return
+     */
+    template <typename Escape>
+    string_t render(const compiled_template & compiled, const json_t & hash);
+
+    /**
+     * render_append
+     * @brief   Renders hash/json values into a compiled template with an escape policy and appends the output to a caller owned string
+     *
+     * @tparam  Escape      Escape policy, see html_escape
+     */
+    template <typename Escape, typename Allocator>
+    void render_append(std::basic_string<char, std::char_traits<char>, Allocator> & out, const compiled_template & compiled, const json_t & hash);
+
+    /**
+     * render_append
+     * @brief   Renders hash/json values into a compiled template and appends the output to a string with any allocator,
+     *          e.g. a std::pmr::string. A polymorphic allocator's resource is used for the renderer's scratch state too.
+     */
+    template <typename Allocator>
+    void render_append(std::basic_string<char, std::char_traits<char>, Allocator> & out, const compiled_template & compiled, const json_t & hash);
+
+    /**
+     * compiled_template
+     *
+     * @brief   Template that has been tokenized into literal segments and tags by tuft::compile()
+     *
+     * @note    The text and nodes are shared by copies of a compiled template. They either belong to it
+     *          or, for a template from tuft::deserialize(), live in the caller's buffer, e.g. a mapped file.
+     */
+    class compiled_template
+    {
+    public:
+        /** @brief Mustache template string this was compiled from */
+        string_view_t source() const { return text_.substr(0, source_size_); }
+
+        /** @brief Source followed by the tag names that aren't a part of it. Node offsets refer to this. */
+        string_view_t text() const { return text_; }
+
+        /** @brief Options this was compiled with */
+        const options_t& options() const { return options_; }
+
+        /** @brief Literal segments and tags in template order */
+        detail::node_span nodes() const { return nodes_; }
+
+        /** @brief Text of a literal node or name of a tag node */
+        string_view_t text(const detail::node& n) const { return text_.substr(n.offset, n.length); }
+
+        /** @brief Output size expected from the recent renders, or 0 if it hasn't been rendered to a string yet */
+        size_t expected_size() const { return size_hint_.get(); }
+
+    private:
+        friend compiled_template deserialize(string_view_t data, std::shared_ptr<const void> owner);
+
+        template <typename Storage>
+        friend compiled_template detail::make_compiled(const template_t& t, const options_t& opts, std::shared_ptr<Storage> storage);
+
+        template <typename Escape, typename Allocator>
+        friend void render_append(std::basic_string<char, std::char_traits<char>, Allocator> & out, const compiled_template & compiled, const json_t & hash);
+
+#if TUFT_STATIC_TEMPLATES
+        template <size_t NodeCount, size_t TextSize, fixed_string Open, fixed_string Close>
+        friend class static_template;
+#endif
+
+        /** Keeps the memory of text_ and nodes_ alive */
+        std::shared_ptr<const void> storage_;
+
+        string_view_t text_;
+        size_t source_size_ = 0;
+        detail::node_span nodes_;
+        options_t options_;
+
+        /** Recent output sizes. This is the only state that changes after compiling and it is atomic. */
+        mutable detail::size_hint size_hint_;
+    };
+
+    /** @brief  Default size of the chunks that a sink passes to its writer */
+    constexpr size_t default_chunk_size = 16 * 1024;
+
+    /**
+     * sink
+     *
+     * @brief   Streams rendered output to a writer in chunks instead of building the whole string first
+     *
+     * @note    Writer is any callable that takes a string_view_t. The view is only valid during the call.
+     *          The chunk is a fixed size buffer that is written out whenever it fills up, and once more
+     *          when rendering is done.
+     */
+    template <typename Writer>
+    class sink
+    {
+    public:
+        explicit sink(Writer writer, size_t chunk_size = default_chunk_size)
+            : writer_(std::move(writer)), chunk_size_(chunk_size)
+        {
+            buffer_.reserve(chunk_size_);
+        }
+
+        /** @brief Adds rendered text, writing out the chunk first if the text doesn't fit */
+        void append(const char* data, size_t size)
+        {
+            if (buffer_.size() + size > chunk_size_)
+            {
+                flush();
+
+                // Text that fills a whole chunk by itself is written straight through
+                if (size >= chunk_size_)
+                {
+                    writer_(string_view_t(data, size));
+                    return;
+                }
+            }
+
+            buffer_.append(data, size);
+        }
+
+        /** @brief Writes out any buffered text */
+        void flush()
+        {
+            if (buffer_.empty())
+                return;
+
+            writer_(string_view_t(buffer_));
+            buffer_.clear();
+        }
+
+    private:
+        Writer writer_;
+        size_t chunk_size_;
+        string_t buffer_;
+    };
+
+    /** @brief  Creates a sink that passes each chunk to a callback taking a string_view_t */
+    template <typename Writer>
+    sink<Writer> make_sink(Writer writer, size_t chunk_size = default_chunk_size)
+    {
+        return sink<Writer>(std::move(writer), chunk_size);
+    }
+
+    /** @brief  Creates a sink that writes each chunk to an output stream */
+    inline auto make_ostream_sink(std::ostream& os, size_t chunk_size = default_chunk_size)
+    {
+        return make_sink([&os](string_view_t chunk) { os.write(chunk.data(), chunk.size()); }, chunk_size);
+    }
+
+    /** @brief  Creates a sink that copies each chunk to an output iterator, e.g. std::back_inserter */
+    template <typename OutputIt>
+    auto make_iterator_sink(OutputIt it, size_t chunk_size = default_chunk_size)
+    {
+        return make_sink([it](string_view_t chunk) mutable { it = std::copy(chunk.begin(), chunk.end(), it); }, chunk_size);
+    }
+
+    /**
+     * render
+     * @brief   Renders hash/json values into a compiled template and streams the output to a sink
+     *
+     * @param   compiled    Template returned from tuft::compile()
+     * @param   hash        JSON object
+     * @param   out         Sink that receives the output. It is flushed once rendering is done.
+     */
+    template <typename Writer>
+    void render(const compiled_template & compiled, const json_t & hash, sink<Writer> & out)
+    {
+        detail::with_escape(compiled.options().escape, [&](auto escape)
+        {
+            detail::execute<decltype(escape)>(compiled, out, hash);
+        });
+
+        out.flush();
+    }
+
+    /**
+     * render
+     * @brief   Renders hash/json values into mustache template and streams the output to a sink
+     *
+     * @param   templ   Mustache template string
+     * @param   hash    JSON object
+     * @param   out     Sink that receives the output. It is flushed once rendering is done.
+     * @param   options Configuration
+     */
+    template <typename Writer>
+    void render(const template_t & templ, const json_t & hash, sink<Writer> & out, const options_t options = options_t())
+    {
+        render(compile(templ, options), hash, out);
+    }
+
+    /** @brief  Default memory budget of a template_cache in bytes */
+    constexpr size_t default_cache_capacity = 16 * 1024 * 1024;
+
+    /**
+     * template_cache
+     *
+     * @brief   Thread-safe cache of compiled templates keyed by template text and delimiters
+     *
+     * @note    Entries are spread over shards that each have their own reader/writer lock. A hit only takes
+     *          the shared lock and sets the entry's reference bit, so lookups of the same template don't
+     *          serialize threads. Once a shard's share of the memory budget is used up it evicts templates
+     *          that haven't been referenced since the last sweep (CLOCK, an approximation of least recently
+     *          used). Templates are handed out as shared pointers, so evicting one doesn't affect renders
+     *          that are still using it.
+     */
+    class template_cache
+    {
+    public:
+        using value_t = std::shared_ptr<const compiled_template>;
+
+        /**
+         * @param capacity  Approximate memory budget in bytes for all compiled templates
+         * @param shards    Number of independently locked shards
+         */
+        explicit template_cache(size_t capacity = default_cache_capacity, size_t shards = 16)
+            : shards_(std::max<size_t>(shards, 1)), shard_capacity_(capacity / std::max<size_t>(shards, 1))
+        {
+        }
+
+        /**
+         * get
+         * @brief   Returns the compiled template for the text and options, compiling it on a miss
+         *
+         * @note    Templates are compiled outside of the lock. If two threads miss the same template
+         *          at once both compile it and the first one to finish is kept.
+         */
+        value_t get(const template_t & templ, const options_t & options = options_t())
+        {
+            const size_t hash = hash_key(templ, options);
+            shard& s = shards_[hash % shards_.size()];
+
+            {
+                std::shared_lock<std::shared_mutex> lock(s.mutex);
+
+                if (auto found = s.find(hash, templ, options))
+                    return found;
+            }
+
+            auto compiled = std::make_shared<const compiled_template>(compile(templ, options));
+            const size_t cost = memory_usage(*compiled);
+
+            // Too big to ever fit in the shard, hand it out without caching it
+            if (cost > shard_capacity_)
+                return compiled;
+
+            std::lock_guard<std::shared_mutex> lock(s.mutex);
+
+            if (auto found = s.find(hash, templ, options))
+                return found;
+
+            s.entries.emplace_back(hash, cost, compiled);
+            s.index.emplace(hash, std::prev(s.entries.end()));
+            s.usage += cost;
+
+            while (s.usage > shard_capacity_)
+                s.evict();
+
+            return compiled;
+        }
+
+        /** @brief Renders hash/json values into mustache template, compiling it only if it isn't cached */
+        string_t render(const template_t & templ, const json_t & hash, const options_t & options = options_t())
+        {
+            return tuft::render(*get(templ, options), hash);
+        }
+
+        /** @brief Removes all templates */
+        void clear()
+        {
+            for (auto& s : shards_)
+            {
+                std::lock_guard<std::shared_mutex> lock(s.mutex);
+                s.entries.clear();
+                s.index.clear();
+                s.usage = 0;
+            }
+        }
+
+        /** @brief Number of cached templates */
+        size_t size() const
+        {
+            size_t count = 0;
+
+            for (auto& s : shards_)
+            {
+                std::shared_lock<std::shared_mutex> lock(s.mutex);
+                count += s.entries.size();
+            }
+
+            return count;
+        }
+
+        /** @brief Approximate memory used by the cached templates in bytes */
+        size_t memory_usage() const
+        {
+            size_t usage = 0;
+
+            for (auto& s : shards_)
+            {
+                std::shared_lock<std::shared_mutex> lock(s.mutex);
+                usage += s.usage;
+            }
+
+            return usage;
+        }
+
+    private:
+        struct entry
+        {
+            entry(size_t hash, size_t cost, value_t compiled) : hash(hash), cost(cost), compiled(std::move(compiled)) {}
+
+            size_t hash;
+            size_t cost;
+            value_t compiled;
+
+            /** Set by hits under the shared lock, cleared by eviction sweeps */
+            mutable std::atomic<bool> referenced {false};
+        };
+
+        struct shard
+        {
+            mutable std::shared_mutex mutex;
+
+            /** Oldest first, the eviction sweep starts at the front */
+            std::list<entry> entries;
+            std::unordered_multimap<size_t, std::list<entry>::iterator> index;
+            size_t usage = 0;
+
+            /**
+             * @return  Cached template or nullptr. Hash collisions are resolved by comparing the text.
+             *
+             * @note    Only needs the shared lock. The reference bit is written only if it isn't set yet,
+             *          so a hot template's entry stays in every reader's cache.
+             */
+            value_t find(size_t hash, const template_t & templ, const options_t & options) const
+            {
+                auto range = index.equal_range(hash);
+
+                for (auto it = range.first; it != range.second; ++it)
+                {
+                    const compiled_template& compiled = *it->second->compiled;
+
+                    if (compiled.source() == templ &&
+                        compiled.options().delim_open == options.delim_open &&
+                        compiled.options().delim_close == options.delim_close &&
+                        compiled.options().max_depth == options.max_depth &&
+                        compiled.options().escape == options.escape)
+                    {
+                        const entry& found = *it->second;
+
+                        if (!found.referenced.load(std::memory_order_relaxed))
+                            found.referenced.store(true, std::memory_order_relaxed);
+
+                        return found.compiled;
+                    }
+                }
+
+                return nullptr;
+            }
+
+            /** @brief Evicts the oldest entry that hasn't been referenced. Referenced ones get a second chance at the back. */
+            void evict()
+            {
+                // Needs the exclusive lock. Every entry is cleared before it is moved, so this ends within two rounds.
+                while (entries.front().referenced.load(std::memory_order_relaxed))
+                {
+                    entries.front().referenced.store(false, std::memory_order_relaxed);
+                    entries.splice(entries.end(), entries, entries.begin());
+                }
+
+                auto victim = entries.begin();
+                auto range = index.equal_range(victim->hash);
+
+                for (auto it = range.first; it != range.second; ++it)
+                {
+                    if (it->second == victim)
+                    {
+                        index.erase(it);
+                        break;
+                    }
+                }
+
+                usage -= victim->cost;
+                entries.erase(victim);
+            }
+        };
+
+        static size_t hash_key(const template_t & templ, const options_t & options)
+        {
+            std::hash<string_view_t> hasher;
+
+            size_t hash = hasher(templ);
+            hash ^= hasher(options.delim_open)  + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+            hash ^= hasher(options.delim_close) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+
+            return hash;
+        }
+
+        /** @return Approximate size of a compiled template in memory */
+        static size_t memory_usage(const compiled_template & compiled)
+        {
+            return sizeof(compiled_template) + compiled.text().size() + compiled.nodes().size() * sizeof(detail::node);
+        }
+
+        std::vector<shard> shards_;
+        size_t shard_capacity_;
+    };
+
+    /**
+     * template_registry
+     *
+     * @brief   Named compiled templates that can be replaced while they are being rendered
+     *
+     * @note    Writers copy the immutable snapshot of all templates, change the copy, publish it with an atomic
+     *          store and bump a version counter. Each reader thread caches the snapshot it last loaded and only
+     *          reads the version counter while it is current, so lookups take no lock and share no reference
+     *          count with other threads. The first lookup on a thread after a change loads the new snapshot,
+     *          which may briefly take the standard library's lock for atomic shared pointers. Renders that
+     *          already hold a template finish on that version, later lookups get the new one. A thread keeps
+     *          the snapshot it last read alive until its next lookup. Writes copy the name table, so batch
+     *          them with update() when changing many templates.
+     */
+    class template_registry
+    {
+    public:
+        using value_t = std::shared_ptr<const compiled_template>;
+        using map_t   = std::unordered_map<string_t, value_t>;
+
+        template_registry() : snapshot_(std::make_shared<const map_t>()), id_(next_id()) {}
+
+        template_registry(const template_registry&) = delete;
+        template_registry& operator=(const template_registry&) = delete;
+
+        /** @return Current version of the named template or nullptr if there is none */
+        value_t get(const string_t & name) const
+        {
+            const map_t& templates = *current();
+            auto found = templates.find(name);
+
+            return found != templates.end() ? found->second : nullptr;
+        }
+
+        /** @return Immutable snapshot of all templates */
+        std::shared_ptr<const map_t> snapshot() const
+        {
+            return current();
+        }
+
+        /** @brief Compiles a template and publishes it under a name, replacing any previous version */
+        void set(const string_t & name, const template_t & templ, const options_t & options = options_t())
+        {
+            set(name, std::make_shared<const compiled_template>(compile(templ, options)));
+        }
+
+        /** @brief Publishes a compiled template under a name, replacing any previous version */
+        void set(const string_t & name, value_t compiled)
+        {
+            update([&](map_t& templates) { templates[name] = std::move(compiled); });
+        }
+
+        /** @return True if the named template existed and was removed */
+        bool erase(const string_t & name)
+        {
+            bool erased = false;
+            update([&](map_t& templates) { erased = templates.erase(name) > 0; });
+
+            return erased;
+        }
+
+        /**
+         * update
+         * @brief   Applies several changes to a copy of the templates and publishes them all at once
+         *
+         * @param   edit    Callable that takes a map_t& to change
+         */
+        template <typename Edit>
+        void update(Edit edit)
+        {
+            std::lock_guard<std::mutex> lock(write_mutex_);
+
+            auto templates = std::make_shared<map_t>(*load());
+            edit(*templates);
+
+#if defined(__cpp_lib_atomic_shared_ptr)
+            snapshot_.store(std::move(templates), std::memory_order_release);
+#else
+            std::atomic_store_explicit(&snapshot_, std::shared_ptr<const map_t>(std::move(templates)), std::memory_order_release);
+#endif
+
+            // Readers see the new version only after the snapshot it stands for is stored
+            version_.fetch_add(1, std::memory_order_release);
+        }
+
+        /**
+         * render
+         * @brief   Renders hash/json values into the current version of a named template
+         *
+         * @throw   tuft::exception if there is no template with that name
+         */
+        string_t render(const string_t & name, const json_t & hash) const
+        {
+            // The thread's cached snapshot keeps the template alive, its reference count isn't touched
+            const map_t& templates = *current();
+            auto found = templates.find(name);
+
+            if (found == templates.end() || !found->second)
+                throw exception("tuft::template_registry - Unknown template '" + name + "'");
+
+            return tuft::render(*found->second, hash);
+        }
+
+    private:
+        /** @brief  Snapshot a thread read last from a registry */
+        struct reader_slot
+        {
+            uint64_t registry = 0;
+            uint64_t version = 0;
+            std::shared_ptr<const map_t> templates;
+        };
+
+        /** @return Unique id of a registry, so a cached snapshot can't be mistaken for one of a registry at the same address */
+        static uint64_t next_id()
+        {
+            static std::atomic<uint64_t> last {0};
+            return last.fetch_add(1, std::memory_order_relaxed) + 1;
+        }
+
+        /** @return This thread's cache slot for a registry. Registries whose ids collide take turns in it. */
+        static reader_slot& slot_of(uint64_t id)
+        {
+            thread_local reader_slot slots[8];
+            return slots[id % 8];
+        }
+
+        /** @return Published snapshot, loaded atomically */
+        std::shared_ptr<const map_t> load() const
+        {
+#if defined(__cpp_lib_atomic_shared_ptr)
+            return snapshot_.load(std::memory_order_acquire);
+#else
+            return std::atomic_load_explicit(&snapshot_, std::memory_order_acquire);
+#endif
+        }
+
+        /** @return Current snapshot from this thread's cache, reloaded only when a writer has published a new one */
+        const std::shared_ptr<const map_t>& current() const
+        {
+            const uint64_t version = version_.load(std::memory_order_acquire);
+            reader_slot& slot = slot_of(id_);
+
+            if (slot.registry != id_ || slot.version != version)
+            {
+                slot.templates = load();
+                slot.registry  = id_;
+                slot.version   = version;
+            }
+
+            return slot.templates;
+        }
+
+#if defined(__cpp_lib_atomic_shared_ptr)
+        std::atomic<std::shared_ptr<const map_t>> snapshot_;
+#else
+        std::shared_ptr<const map_t> snapshot_;
+#endif
+        std::atomic<uint64_t> version_ {0};
+        const uint64_t id_;
+        std::mutex write_mutex_;
+    };
+
+#if TUFT_STATIC_TEMPLATES
+    namespace detail
+    {
+        /**
+         * static_parse
+         *
+         * @brief   Nodes and text of a template parsed at compile time, sized for the worst case of a template of Size characters
+         */
+        template <size_t Size>
+        struct static_parse
+        {
+            node nodes[Size + 1] {};
+            char text[2 * Size + 1] {};
+            size_t node_count = 0;
+            size_t text_size = 0;
+        };
+
+        /**
+         * static_template_error
+         *
+         * @brief   Reached while parsing a template at compile time only if it is malformed. As it isn't constexpr,
+         *          compilation stops and the diagnostic points at the call with the message.
+         */
+        inline void static_template_error(const char* message)
+        {
+            throw exception(message);
+        }
+
+        /**
+         * tokenize_static
+         *
+         * @brief   Splits a template into nodes during compilation, with the same rules as tokenize()
+         */
+        template <size_t Size>
+        constexpr static_parse<Size> tokenize_static(string_view_t t, string_view_t open, string_view_t close)
+        {
+            static_parse<Size> parsed;
+
+            if (open.empty() || close.empty())
+                static_template_error("tuft::compile_static - Delimiters must not be empty");
+
+            for (size_t i = 0; i < t.size(); ++i)
+                parsed.text[i] = t[i];
+
+            parsed.text_size = t.size();
+
+            // Indices of the section nodes that have not been closed yet
+            size_t open_sections[Size + 1] {};
+            size_t depth = 0;
+
+            auto add_literal = [&](size_t b, size_t e)
+            {
+                if (b == e)
+                    return;
+
+                node literal;
+                literal.offset = static_cast<uint32_t>(b);
+                literal.length = static_cast<uint32_t>(e - b);
+                parsed.nodes[parsed.node_count++] = literal;
+
+                // Counted for the innermost open section only, nested sections may not be rendered
+                if (depth != 0)
+                    parsed.nodes[open_sections[depth - 1]].literal_length += literal.length;
+            };
+
+            auto name_of = [&](const node& tag)
+            {
+                return string_view_t(parsed.text, parsed.text_size).substr(tag.offset, tag.length);
+            };
+
+            size_t remaining = 0;
+
+            while (true)
+            {
+                const size_t tag_begin = t.find(open, remaining); // Before "{{"
+
+                if (tag_begin == string_view_t::npos)
+                    break;
+
+                const size_t after_tag_begin = tag_begin + open.size();
+                string_view_t delim_close = close;
+
+                // Special case for triple mustache escape
+                if (open == "{{" && close == "}}" && after_tag_begin < t.size() && t[after_tag_begin] == '{')
+                    delim_close = "}}}";
+
+                size_t tag_end = t.find(delim_close, after_tag_begin); // After "}}"
+                tag_end = tag_end == string_view_t::npos ? t.size() : tag_end + delim_close.size();
+
+                add_literal(remaining, tag_begin);
+
+                if (tag_end - tag_begin < open.size() + close.size() || (tag_end == t.size() && !t.ends_with(close)))
+                    static_template_error("tuft::compile_static - Could not find closing delimiter for tag");
+
+                const string_view_t tag = t.substr(tag_begin, tag_end - tag_begin);
+                const string_view_t inside = t.substr(after_tag_begin, tag_end - close.size() - after_tag_begin);
+
+                // Name is the interior without symbols and mustaches, the type is the first symbol
+                char name_buffer[Size + 1] {};
+                size_t name_size = 0;
+                tag_type type = tag_type::variable;
+
+                for (char c : inside)
+                {
+                    const bool symbol = c == '&' || c == '#' || c == '^' || c == '/' || c == '!';
+
+                    if (symbol && type == tag_type::variable)
+                        type = static_cast<tag_type>(c);
+
+                    if (!symbol && c != '{' && c != '}')
+                        name_buffer[name_size++] = c;
+                }
+
+                const string_view_t name(name_buffer, name_size);
+
+                // Points the node at its name in the source if it is there as is, otherwise adds it after the source
+                auto set_name = [&](node& n)
+                {
+                    size_t offset = tag.find(name);
+
+                    if (offset != string_view_t::npos)
+                    {
+                        offset += tag_begin;
+                    }
+                    else
+                    {
+                        offset = parsed.text_size;
+
+                        for (char c : name)
+                            parsed.text[parsed.text_size++] = c;
+                    }
+
+                    n.offset = static_cast<uint32_t>(offset);
+                    n.length = static_cast<uint32_t>(name_size);
+                };
+
+                switch (type)
+                {
+                    case tag_type::variable:
+                    case tag_type::escaped:
+                    {
+                        node variable;
+                        variable.type     = node_type::variable;
+                        variable.escape   = type != tag_type::escaped && !(tag.size() >= 6 && tag.starts_with("{{{") && tag.ends_with("}}}"));
+                        variable.implicit = name.empty() || name == ".";
+                        set_name(variable);
+                        parsed.nodes[parsed.node_count++] = variable;
+                        break;
+                    }
+
+                    case tag_type::section:
+                    case tag_type::inverted_section:
+                    {
+                        open_sections[depth++] = parsed.node_count;
+
+                        node section;
+                        section.type = type == tag_type::inverted_section ? node_type::inverted_section : node_type::section;
+                        set_name(section);
+                        parsed.nodes[parsed.node_count++] = section;
+                        break;
+                    }
+
+                    case tag_type::end_section:
+                    {
+                        if (depth == 0 || name_of(parsed.nodes[open_sections[depth - 1]]) != name)
+                            static_template_error("tuft::compile_static - Unexpected closing tag");
+
+                        node& section = parsed.nodes[open_sections[--depth]];
+                        section.end = static_cast<uint32_t>(parsed.node_count);
+                        break;
+                    }
+
+                    case tag_type::comment:
+                    default:
+                        // Comments aren't altered
+                        add_literal(tag_begin, tag_end);
+                        break;
+                }
+
+                // Move past current tag.
+                remaining = tag_end;
+            }
+
+            // Append anything remaining after the last tag
+            add_literal(remaining, t.size());
+
+            if (depth != 0)
+                static_template_error("tuft::compile_static - Could not find closing tag");
+
+            return parsed;
+        }
+    }
+
+    /**
+     * static_template
+     *
+     * @brief   Template that was parsed during compilation by tuft::compile_static(). Its nodes and text are constants.
+     */
+    template <size_t NodeCount, size_t TextSize, fixed_string Open, fixed_string Close>
+    class static_template
+    {
+    public:
+        template <size_t Size>
+        constexpr explicit static_template(const detail::static_parse<Size>& parsed, size_t source_size) : source_size_(source_size)
+        {
+            for (size_t i = 0; i < NodeCount; ++i)
+                nodes_[i] = parsed.nodes[i];
+
+            for (size_t i = 0; i < TextSize; ++i)
+                text_[i] = parsed.text[i];
+        }
+
+        /** @brief Mustache template string this was compiled from */
+        constexpr string_view_t source() const { return string_view_t(text_, source_size_); }
+
+        /** @brief Literal segments and tags in template order */
+        constexpr detail::node_span nodes() const { return detail::node_span {nodes_, NodeCount}; }
+
+        /**
+         * view
+         * @brief   Compiled template that refers to this one's nodes and text without copying them
+         *
+         * @note    The result must not outlive this template. Templates in constexpr or static variables live for the whole program.
+         */
+        compiled_template view() const
+        {
+            compiled_template compiled;
+            compiled.text_        = string_view_t(text_, TextSize);
+            compiled.source_size_ = source_size_;
+            compiled.nodes_       = nodes();
+            compiled.options_     = options_t(string_t(Open.view()), string_t(Close.view()));
+
+            return compiled;
+        }
+
+    private:
+        // Arrays can't be empty, the spare element of an empty template is never used
+        detail::node nodes_[NodeCount > 0 ? NodeCount : 1] {};
+        char text_[TextSize > 0 ? TextSize : 1] {};
+        size_t source_size_ = 0;
+    };
+
+    /**
+     * compile_static
+     * @brief   Tokenizes a mustache template while the program is being compiled
+     *
+     * @tparam  Templ   Mustache template string literal
+     * @tparam  Open    Opening delimiter
+     * @tparam  Close   Closing delimiter
+     * @return  Template that only needs lookups and appends to render. A malformed template is a compile error.
+     */
+    template <fixed_string Templ, fixed_string Open = "{{", fixed_string Close = "}}">
+    consteval auto compile_static()
+    {
+        constexpr auto parsed = detail::tokenize_static<Templ.size()>(Templ.view(), Open.view(), Close.view());
+
+        return static_template<parsed.node_count, parsed.text_size, Open, Close>(parsed, Templ.size());
+    }
+
+    /**
+     * render
+     * @brief   Renders hash/json values into a template from tuft::compile_static()
+     */
+    template <size_t NodeCount, size_t TextSize, fixed_string Open, fixed_string Close>
+    string_t render(const static_template<NodeCount, TextSize, Open, Close> & compiled, const json_t & hash)
+    {
+        return render(compiled.view(), hash);
+    }
+
+    /**
+     * render
+     * @brief   Renders hash/json values into a string literal template that is parsed during compilation,
+     *          e.g. tuft::render<"Hello {{name}}">(hash)
+     *
+     * @param   hash    JSON object
+     */
+    template <fixed_string Templ, fixed_string Open = "{{", fixed_string Close = "}}">
+    string_t render(const json_t & hash)
+    {
+        static constexpr auto compiled = compile_static<Templ, Open, Close>();
+        static const compiled_template view = compiled.view();
+
+        return render(view, hash);
+    }
+#endif
+
+    inline string_t render(const template_t & t, const json_t & hash, options_t options)
+    {
+        if (t.size() == 0)
+            return string_t();
+
+        return render(compile(t, options), hash);
+    }
+
+    inline compiled_template compile(const template_t & t, const options_t options)
+    {
+        return detail::make_compiled(t, options, std::make_shared<detail::template_storage>());
+    }
+
+#if TUFT_PMR
+    inline compiled_template compile(const template_t & t, const options_t options, std::pmr::memory_resource* resource)
+    {
+        using storage_t = detail::basic_template_storage<std::pmr::polymorphic_allocator<char>>;
+
+        // The control block and the storage come from the resource too
+        const std::pmr::polymorphic_allocator<char> alloc(resource);
+        return detail::make_compiled(t, options, std::allocate_shared<storage_t>(alloc, alloc));
+    }
+#endif
+
+    namespace detail
+    {
+        /** @brief  Tokenizes t into storage and returns a view of it that keeps storage alive */
+        template <typename Storage>
+        compiled_template make_compiled(const template_t& t, const options_t& opts, std::shared_ptr<Storage> storage)
+        {
+            tokenize(t, *storage, opts);
+
+            compiled_template compiled;
+            compiled.text_        = string_view_t(storage->text);
+            compiled.source_size_ = t.size();
+            compiled.nodes_       = node_span {storage->nodes.data(), storage->nodes.size()};
+            compiled.options_     = opts;
+            compiled.storage_     = std::move(storage);
+
+            return compiled;
+        }
+    }
+
+    inline string_t serialize(const compiled_template & compiled)
+    {
+        const auto& opts  = compiled.options();
+        const auto  nodes = compiled.nodes();
+        const auto  text  = compiled.text();
+
+        detail::blob_header header {};
+        std::memcpy(header.magic, detail::blob_magic, sizeof(header.magic));
+        header.version          = detail::blob_version;
+        header.byte_order       = detail::blob_byte_order;
+        header.node_count       = static_cast<uint32_t>(nodes.size());
+        header.text_size        = static_cast<uint32_t>(text.size());
+        header.source_size      = static_cast<uint32_t>(compiled.source().size());
+        header.delim_open_size  = static_cast<uint32_t>(opts.delim_open.size());
+        header.delim_close_size = static_cast<uint32_t>(opts.delim_close.size());
+        header.max_depth        = static_cast<uint32_t>(std::min<size_t>(opts.max_depth, std::numeric_limits<uint32_t>::max()));
+        header.escape           = static_cast<uint32_t>(opts.escape);
+
+        string_t data;
+        data.reserve(sizeof(header) + nodes.size() * sizeof(detail::node) + text.size() + opts.delim_open.size() + opts.delim_close.size());
+
+        data.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        data.append(reinterpret_cast<const char*>(nodes.begin()), nodes.size() * sizeof(detail::node));
+        data.append(text);
+        data.append(opts.delim_open);
+        data.append(opts.delim_close);
+
+        return data;
+    }
+
+    inline compiled_template deserialize(string_view_t data, std::shared_ptr<const void> owner)
+    {
+        using detail::node;
+
+        const bool aligned = reinterpret_cast<uintptr_t>(data.data()) % alignof(node) == 0;
+
+        if (!owner || !aligned)
+        {
+            auto copy = std::make_shared<const string_t>(data);
+            data  = *copy;
+            owner = std::move(copy);
+        }
+
+        detail::blob_header header;
+
+        if (data.size() < sizeof(header))
+            throw exception("tuft::deserialize - Data is too short");
+
+        std::memcpy(&header, data.data(), sizeof(header));
+
+        if (std::memcmp(header.magic, detail::blob_magic, sizeof(header.magic)) != 0)
+            throw exception("tuft::deserialize - Data is not a serialized template");
+
+        if (header.version != detail::blob_version || header.byte_order != detail::blob_byte_order)
+            throw exception("tuft::deserialize - Serialized template has an unsupported version or byte order");
+
+        const uint64_t nodes_size = uint64_t(header.node_count) * sizeof(node);
+        const uint64_t size = sizeof(header) + nodes_size + header.text_size + header.delim_open_size + header.delim_close_size;
+
+        if (data.size() < size || header.source_size > header.text_size)
+            throw exception("tuft::deserialize - Serialized template is truncated");
+
+        if (header.escape > static_cast<uint32_t>(escape_t::js))
+            throw exception("tuft::deserialize - Serialized template has an unknown escape policy");
+
+        const char* p = data.data() + sizeof(header);
+        const node* nodes = reinterpret_cast<const node*>(p);
+        string_view_t text(p + nodes_size, header.text_size);
+
+        // Check everything the renderer relies on, so a corrupt file can't make it read out of bounds.
+        // The enum and bool bytes are checked as raw bytes first, loading an invalid bool is undefined.
+        for (uint32_t i = 0; i < header.node_count; ++i)
+        {
+            const auto raw = reinterpret_cast<const unsigned char*>(nodes + i);
+
+            if (raw[offsetof(node, type)] > static_cast<unsigned char>(detail::node_type::inverted_section) ||
+                raw[offsetof(node, escape)] > 1 || raw[offsetof(node, implicit)] > 1 || raw[offsetof(node, reserved)] > 1)
+                throw exception("tuft::deserialize - Serialized template has an invalid node");
+
+            const node& n = nodes[i];
+            const bool is_section = n.type == detail::node_type::section || n.type == detail::node_type::inverted_section;
+
+            // The literals of a section are a part of the text, so they bound the room it reserves
+            if (uint64_t(n.offset) + n.length > header.text_size ||
+                n.literal_length > header.text_size ||
+                (is_section && (n.end <= i || n.end > header.node_count)))
+                throw exception("tuft::deserialize - Serialized template has an invalid node");
+        }
+
+        compiled_template compiled;
+        compiled.text_        = text;
+        compiled.source_size_ = header.source_size;
+        compiled.nodes_       = detail::node_span {nodes, header.node_count};
+        compiled.options_     = options_t(string_t(text.data() + text.size(), header.delim_open_size),
+                                          string_t(text.data() + text.size() + header.delim_open_size, header.delim_close_size));
+        compiled.storage_     = std::move(owner);
+
+        // No template can nest that deep with 32 bit node positions, it stands for any larger limit
+        compiled.options_.max_depth = header.max_depth == std::numeric_limits<uint32_t>::max() ? std::numeric_limits<size_t>::max() : header.max_depth;
+
+        compiled.options_.escape = static_cast<escape_t>(header.escape);
+
+        return compiled;
+    }
+
+    inline string_t render(const compiled_template & compiled, const json_t & hash)
+    {
+        string_t rendered;
+        render_append(rendered, compiled, hash);
+
+        return rendered;
+    }
+
+    inline void render_into(string_t & out, const compiled_template & compiled, const json_t & hash)
+    {
+        out.clear(); // keeps capacity
+        render_append(out, compiled, hash);
+    }
+
+    inline void render_into(string_t & out, const template_t & t, const json_t & hash, const options_t options)
+    {
+        out.clear(); // keeps capacity
+        render_append(out, t, hash, options);
+    }
+
+    inline void render_append(string_t & out, const compiled_template & compiled, const json_t & hash)
+    {
+        detail::with_escape(compiled.options().escape, [&](auto escape)
+        {
+            render_append<decltype(escape)>(out, compiled, hash);
+        });
+    }
+
+    template <typename Escape>
+    string_t render(const compiled_template & compiled, const json_t & hash)
+    {
+        string_t rendered;
+        render_append<Escape>(rendered, compiled, hash);
+
+        return rendered;
+    }
+
+    template <typename Allocator>
+    void render_append(std::basic_string<char, std::char_traits<char>, Allocator> & out, const compiled_template & compiled, const json_t & hash)
+    {
+        detail::with_escape(compiled.options().escape, [&](auto escape)
+        {
+            render_append<decltype(escape)>(out, compiled, hash);
+        });
+    }
+
+    template <typename Escape, typename Allocator>
+    void render_append(std::basic_string<char, std::char_traits<char>, Allocator> & out, const compiled_template & compiled, const json_t & hash)
+    {
+        if (compiled.source().size() == 0)
+            return;
+
+        // Until there is a history of output sizes the template size is a fair guess, tag names are removed
+        const size_t start = out.size();
+        detail::reserve_output(out, std::max(compiled.expected_size(), compiled.source().size()));
+        detail::execute<Escape>(compiled, out, hash);
+
+        compiled.size_hint_.record(out.size() - start);
+    }
+
+    inline size_t rendered_size(const compiled_template & compiled, const json_t & hash)
+    {
+        detail::size_counter counter;
+
+        detail::with_escape(compiled.options().escape, [&](auto escape)
+        {
+            detail::execute<decltype(escape)>(compiled, counter, hash);
+        });
+
+        return counter.size;
+    }
+
+    inline render_result render_to(char* buffer, size_t capacity, const compiled_template & compiled, const json_t & hash)
+    {
+        // One character is kept for the terminating null
+        detail::fixed_buffer out {buffer, capacity == 0 ? 0 : capacity - 1};
+
+        try
+        {
+            detail::with_escape(compiled.options().escape, [&](auto escape)
+            {
+                detail::execute<decltype(escape)>(compiled, out, hash);
+            });
+        }
+        catch (...)
+        {
+            if (capacity != 0)
+                buffer[0] = '\0';
+
+            throw;
+        }
+
+        render_result result;
+        result.written = std::min(out.size, out.capacity);
+        result.size    = out.size;
+
+        if (capacity != 0)
+            buffer[result.written] = '\0';
+
+        return result;
+    }
+
+    inline void render_append(string_t & out, const template_t & t, const json_t & hash, const options_t options)
+    {
+        if (t.size() == 0)
+            return;
+
+        render_append(out, compile(t, options), hash);
+    }
+
+#if TUFT_PMR
+    inline std::pmr::string render(const compiled_template & compiled, const json_t & hash, std::pmr::memory_resource* resource)
+    {
+        std::pmr::string rendered(resource);
+        render_append(rendered, compiled, hash);
+
+        return rendered;
+    }
+
+    inline std::pmr::string render(const template_t & t, const json_t & hash, std::pmr::memory_resource* resource, const options_t options)
+    {
+        std::pmr::string rendered(resource);
+
+        if (t.size() != 0)
+            render_append(rendered, compile(t, options, resource), hash);
+
+        return rendered;
+    }
+#endif
+
+    namespace detail
+    {
+#if TUFT_AVX2
+        /** @return True if the cpu supports AVX2. Checked once. */
+        inline bool has_avx2()
+        {
+            static const bool supported = __builtin_cpu_supports("avx2");
+            return supported;
+        }
+#endif
+
+        /**
+         * find_delimiter_scalar
+         *
+         * @brief   Portable version of find_delimiter()
+         */
+        inline const char* find_delimiter_scalar(const char* b, const char* e, string_view_t delim)
+        {
+            const size_t size = delim.size();
+
+            while (static_cast<size_t>(e - b) >= size)
+            {
+                b = static_cast<const char*>(std::memchr(b, delim[0], (e - b) - size + 1));
+
+                if (b == nullptr)
+                    return e;
+
+                if (std::memcmp(b + 1, delim.data() + 1, size - 1) == 0)
+                    return b;
+
+                ++b;
+            }
+
+            return e;
+        }
+
+#if TUFT_SSE2
+        /** @return Index of the lowest set bit of a mask that isn't 0 */
+        inline unsigned lowest_bit(unsigned mask)
+        {
+#if defined(_MSC_VER) && !defined(__clang__)
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return static_cast<unsigned>(index);
+#else
+            return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+        }
+
+        /**
+         * match_candidates
+         *
+         * @brief   Verifies the candidate positions of a delimiter found by a vector compare
+         *
+         * @param   p       Start of the block that was compared
+         * @param   mask    Bit i is set if the first two characters of the delimiter match at p + i
+         *
+         * @return  First matching position or nullptr if none of the candidates match
+         */
+        inline const char* match_candidates(const char* p, const char* e, unsigned mask, string_view_t delim)
+        {
+            while (mask != 0)
+            {
+                const char* candidate = p + lowest_bit(mask);
+
+                if (static_cast<size_t>(e - candidate) >= delim.size() &&
+                    std::memcmp(candidate + 2, delim.data() + 2, delim.size() - 2) == 0)
+                    return candidate;
+
+                mask &= mask - 1;
+            }
+
+            return nullptr;
+        }
+
+        /**
+         * find_delimiter_sse2
+         *
+         * @brief   SSE2 version of find_delimiter(). Compares the first two characters of the delimiter 16 positions at a time.
+         */
+        inline const char* find_delimiter_sse2(const char* b, const char* e, string_view_t delim)
+        {
+            const __m128i first  = _mm_set1_epi8(delim[0]);
+            const __m128i second = _mm_set1_epi8(delim[1]);
+
+            // The second compare reads one character ahead
+            for (; e - b > 16; b += 16)
+            {
+                __m128i block      = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+                __m128i block_next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 1));
+
+                unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block, first), _mm_cmpeq_epi8(block_next, second)));
+
+                if (const char* found = match_candidates(b, e, mask, delim))
+                    return found;
+            }
+
+            return find_delimiter_scalar(b, e, delim);
+        }
+#endif
+
+#if TUFT_AVX2
+        /**
+         * find_delimiter_avx2
+         *
+         * @brief   AVX2 version of find_delimiter(). Compares the first two characters of the delimiter 32 positions at a time.
+         */
+        __attribute__((target("avx2")))
+        inline const char* find_delimiter_avx2(const char* b, const char* e, string_view_t delim)
+        {
+            const __m256i first  = _mm256_set1_epi8(delim[0]);
+            const __m256i second = _mm256_set1_epi8(delim[1]);
+
+            // The second compare reads one character ahead
+            for (; e - b > 32; b += 32)
+            {
+                __m256i block      = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+                __m256i block_next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + 1));
+
+                unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block, first), _mm256_cmpeq_epi8(block_next, second)));
+
+                if (const char* found = match_candidates(b, e, mask, delim))
+                    return found;
+            }
+
+            return find_delimiter_sse2(b, e, delim);
+        }
+#endif
+
+        /**
+         * find_delimiter
+         *
+         * @param   b       Beginning of range to search
+         * @param   e       End of range to search
+         * @param   delim   Delimiter to search for
+         *
+         * @return  Pointer to the first occurrence of delim or e if not found
+         *
+         * @note    Uses the widest vector instructions that the cpu supports
+         */
+        inline const char* find_delimiter(const char* b, const char* e, string_view_t delim)
+        {
+            if (delim.empty())
+                return b;
+
+            if (delim.size() == 1)
+            {
+                auto found = static_cast<const char*>(std::memchr(b, delim[0], e - b));
+                return found ? found : e;
+            }
+
+#if TUFT_AVX2
+            if (has_avx2())
+                return find_delimiter_avx2(b, e, delim);
+#endif
+
+#if TUFT_SSE2
+            return find_delimiter_sse2(b, e, delim);
+#else
+            return find_delimiter_scalar(b, e, delim);
+#endif
+        }
+
+        /**
+         * search_delimiter
+         *
+         * @return  Iterator to the first occurrence of delim in [b, e) or e if not found
+         */
+        inline iter search_delimiter(const iter& b, const iter& e, string_view_t delim)
+        {
+            if (b == e)
+                return delim.empty() ? b : e;
+
+            const char* first = &*b;
+            const char* last  = first + distance(b, e);
+
+            return next(b, distance(first, find_delimiter(first, last, delim)));
+        }
+
+        /**
+         * find_next_tag
+         *
+         * @param   b   Beginning of range to search for tag
+         * @param   e   End of range to search for tag
+         *
+         * @param   tag_begin  Out: Iterator to the beginning of the tag before delimiters
+         * @param   tag_end    Out: Iterator to the end of the tag after delimiters
+         *
+         * @return  true if next tag/section is found
+         *
+         * @note    Output iters will be equal to e if not found.
+         */
+        template <typename Delimiters>
+        bool find_next_tag(const iter& b, const iter& e, iter& tag_begin, iter& tag_end, const Delimiters& delims)
+        {
+            tag_begin = e;
+            tag_end = e;
+            tag_begin = search_delimiter(b, e, delims.open());
+
+            if (tag_begin == e)
+                return false;
+
+            auto after_tag_begin = next(tag_begin, delims.open().size());
+            string_view_t delim_close = delims.close();
+
+            // Special case for triple mustache escape. The third brace is checked in the same pass as the tag itself.
+            if constexpr (Delimiters::triple_mustache)
+            {
+                if (after_tag_begin != e && *after_tag_begin == '{')
+                    delim_close = "}}}";
+            }
+
+            tag_end = search_delimiter(after_tag_begin, e, delim_close);
+
+            if (tag_end != e)
+                tag_end = next(tag_end, delim_close.size()); // move after end delimiter
+
+            return (tag_begin != tag_end);
+        }
+
+        /**
+         * inside_tag
+         *
+         * @param b Iterator pointing to beginning of tag before starting delimiter
+         * @param e Iterator pointing to end of tag after ending delimiter
+         *
+         * @return  Pair of begin/end iterators pointing to the interior of the tag between delimiters
+         */
+        template <typename Delimiters>
+        std::pair<iter, iter> inside_tag(const iter& b, const iter& e, const Delimiters& delims)
+        {
+            auto inside_begin = next(b, delims.open().size());  // after  "{{"
+            auto inside_end   = next(e, -static_cast<std::ptrdiff_t>(delims.close().size())); // before "}}"
+
+            return std::make_pair(inside_begin, inside_end);
+        }
+
+        /**
+         * is_tag_symbol
+         *
+         * @return  True if c marks the type of a tag
+         */
+        constexpr bool is_tag_symbol(char c)
+        {
+            return c == '&' || c == '#' || c == '^' || c == '/' || c == '!';
+        }
+
+        /**
+         * tag_info
+         *
+         * @brief   Type, name and escaping of a tag
+         */
+        struct tag_info
+        {
+            tag_type type = tag_type::variable;
+
+            /** Variables: true if the value is escaped */
+            bool escape = true;
+
+            /** Interior without symbols and mustaches. It points into the tag, or into the scratch buffer if symbols split it up. */
+            string_view_t name;
+        };
+
+        /**
+         * classify_tag
+         *
+         * @brief   Finds the type, name and escaping of a tag in one pass over it without allocating
+         *
+         * @param b         Iterator pointing to beginning of tag before starting delimiter
+         * @param e         Iterator pointing to end of tag after ending delimiter
+         * @param scratch   Buffer for the rare name that has a symbol in the middle, e.g. "{{a#b}}". Reuse it across tags.
+         *
+         * @note    The type is the first symbol in the tag, the name is what is left after removing all symbols and mustaches.
+         */
+        template <typename Delimiters, typename String>
+        tag_info classify_tag(const iter& b, const iter& e, const Delimiters& delims, String& scratch)
+        {
+            tag_info info;
+
+            if (b == e)
+                return info;
+
+            auto inside = inside_tag(b, e, delims);
+            const char* first = &*b + distance(b, inside.first);
+            const char* last  = std::max(first, &*b + distance(b, inside.second));
+
+            // First and one past the last character of the name, and how many characters there are in between
+            const char* name_begin = nullptr;
+            const char* name_end   = nullptr;
+            size_t name_size = 0;
+
+            for (const char* p = first; p != last; ++p)
+            {
+                if (is_tag_symbol(*p))
+                {
+                    if (info.type == tag_type::variable)
+                        info.type = static_cast<tag_type>(*p);
+                }
+                else if (*p != '{' && *p != '}')
+                {
+                    if (name_begin == nullptr)
+                        name_begin = p;
+
+                    name_end = p + 1;
+                    ++name_size;
+                }
+            }
+
+            if (name_size == static_cast<size_t>(name_end - name_begin))
+            {
+                info.name = string_view_t(name_begin, name_size);
+            }
+            else
+            {
+                scratch.clear();
+
+                for (const char* p = name_begin; p != name_end; ++p)
+                {
+                    if (!is_tag_symbol(*p) && *p != '{' && *p != '}')
+                        scratch += *p;
+                }
+
+                info.name = scratch;
+            }
+
+            // Special case for triple mustache. The tag is compared in place, nothing is copied.
+            string_view_t tag(&*b, distance(b, e));
+            const bool triple = tag.size() >= 6 && tag.substr(0, 3) == "{{{" && tag.substr(tag.size() - 3) == "}}}";
+
+            info.escape = info.type != tag_type::escaped && !triple;
+
+            return info;
+        }
+
+        /**
+         * append
+         *
+         * @brief   Appends text to the rendered output
+         */
+        template <typename Output>
+        void append(Output& rendered, string_view_t text)
+        {
+            rendered.append(text.data(), text.size());
+        }
+
+        /**
+         * hex_digits
+         *
+         * @brief   Upper case hexadecimal digits for escape sequences
+         */
+        constexpr char hex_digits[] = "0123456789ABCDEF";
+
+        /**
+         * append_code_unit
+         *
+         * @brief   Appends a character as a "\u00XX" escape sequence
+         */
+        template <typename Output>
+        void append_code_unit(Output& rendered, unsigned char c)
+        {
+            const char sequence[6] = { '\\', 'u', '0', '0', hex_digits[c >> 4], hex_digits[c & 0x0F] };
+            rendered.append(sequence, sizeof(sequence));
+        }
+
+#if TUFT_SSE2
+        /** @return 0xFF in each byte of x that is in [lo, hi] */
+        inline __m128i in_range_sse2(__m128i x, char lo, char hi)
+        {
+            __m128i offset = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+            return _mm_cmpeq_epi8(_mm_subs_epu8(offset, _mm_set1_epi8(static_cast<char>(hi - lo))), _mm_setzero_si128());
+        }
+
+        /** @return 0xFF in each byte of x that is a control character, i.e. below 0x20 */
+        inline __m128i is_control_sse2(__m128i x)
+        {
+            const __m128i limit = _mm_set1_epi8(0x1F);
+            return _mm_cmpeq_epi8(_mm_max_epu8(x, limit), limit);
+        }
+#endif
+
+#if TUFT_AVX2
+        __attribute__((target("avx2")))
+        inline __m256i in_range_avx2(__m256i x, char lo, char hi)
+        {
+            __m256i offset = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+            return _mm256_cmpeq_epi8(_mm256_subs_epu8(offset, _mm256_set1_epi8(static_cast<char>(hi - lo))), _mm256_setzero_si256());
+        }
+
+        __attribute__((target("avx2")))
+        inline __m256i is_control_avx2(__m256i x)
+        {
+            const __m256i limit = _mm256_set1_epi8(0x1F);
+            return _mm256_cmpeq_epi8(_mm256_max_epu8(x, limit), limit);
+        }
+#endif
+
+        /**
+         * html_special
+         *
+         * @brief   Characters that are replaced by entities in html text and attribute values
+         *
+         * @note    Escapers for escape_special() describe their special characters three ways, one character at a time
+         *          and 16 or 32 at a time, and append the replacement of the special character at p.
+         */
+        struct html_special
+        {
+            static bool is_special(unsigned char c)
+            {
+                return c == '&' || c == '<' || c == '>' || c == '"' || c == '\'' || c == '/';
+            }
+
+#if TUFT_SSE2
+            static __m128i classify(__m128i x)
+            {
+                return _mm_or_si128(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('&')), _mm_cmpeq_epi8(x, _mm_set1_epi8('<'))),
+                                                 _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('>')), _mm_cmpeq_epi8(x, _mm_set1_epi8('"')))),
+                                    _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\'')), _mm_cmpeq_epi8(x, _mm_set1_epi8('/'))));
+            }
+#endif
+
+#if TUFT_AVX2
+            __attribute__((target("avx2")))
+            static __m256i classify(__m256i x)
+            {
+                return _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('&')), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('<'))),
+                                                       _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('>')), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('"')))),
+                                       _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\'')), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('/'))));
+            }
+#endif
+
+            /** @return Position after the replaced characters */
+            template <typename Output>
+            static const char* replace(Output& rendered, const char* p, const char*)
+            {
+                switch (*p)
+                {
+                case '&':  append(rendered, "&amp;");  break;
+                case '<':  append(rendered, "&lt;");   break;
+                case '>':  append(rendered, "&gt;");   break;
+                case '"':  append(rendered, "&quot;"); break;
+                case '\'': append(rendered, "&#39;");  break;
+                default:   append(rendered, "&#x2F;"); break;
+                }
+
+                return p + 1;
+            }
+        };
+
+        /**
+         * json_special
+         *
+         * @brief   Characters that must be escaped inside a JSON string: quotes, backslashes and control characters
+         */
+        struct json_special
+        {
+            static bool is_special(unsigned char c)
+            {
+                return c < 0x20 || c == '"' || c == '\\';
+            }
+
+#if TUFT_SSE2
+            static __m128i classify(__m128i x)
+            {
+                return _mm_or_si128(is_control_sse2(x), _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('"')), _mm_cmpeq_epi8(x, _mm_set1_epi8('\\'))));
+            }
+#endif
+
+#if TUFT_AVX2
+            __attribute__((target("avx2")))
+            static __m256i classify(__m256i x)
+            {
+                return _mm256_or_si256(is_control_avx2(x), _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('"')), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\\'))));
+            }
+#endif
+
+            /** @return Position after the replaced characters */
+            template <typename Output>
+            static const char* replace(Output& rendered, const char* p, const char*)
+            {
+                switch (*p)
+                {
+                case '"':  append(rendered, "\\\""); break;
+                case '\\': append(rendered, "\\\\"); break;
+                case '\b': append(rendered, "\\b");  break;
+                case '\f': append(rendered, "\\f");  break;
+                case '\n': append(rendered, "\\n");  break;
+                case '\r': append(rendered, "\\r");  break;
+                case '\t': append(rendered, "\\t");  break;
+                default:   append_code_unit(rendered, static_cast<unsigned char>(*p)); break;
+                }
+
+                return p + 1;
+            }
+        };
+
+        /**
+         * js_special
+         *
+         * @brief   Characters that must be escaped inside a JavaScript string in an inline script
+         *
+         * @note    On top of the JSON ones, single quotes and the html characters that could end the script are
+         *          escaped, and so are U+2028 and U+2029, which end a line in older JavaScript.
+         */
+        struct js_special
+        {
+            static bool is_special(unsigned char c)
+            {
+                return json_special::is_special(c) || c == '\'' || c == '<' || c == '>' || c == '&' || c == 0xE2;
+            }
+
+#if TUFT_SSE2
+            static __m128i classify(__m128i x)
+            {
+                __m128i html = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\'')), _mm_cmpeq_epi8(x, _mm_set1_epi8('<'))),
+                                            _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('>')), _mm_cmpeq_epi8(x, _mm_set1_epi8('&'))));
+
+                return _mm_or_si128(_mm_or_si128(json_special::classify(x), html), _mm_cmpeq_epi8(x, _mm_set1_epi8(static_cast<char>(0xE2))));
+            }
+#endif
+
+#if TUFT_AVX2
+            __attribute__((target("avx2")))
+            static __m256i classify(__m256i x)
+            {
+                __m256i html = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\'')), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('<'))),
+                                               _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('>')), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('&'))));
+
+                return _mm256_or_si256(_mm256_or_si256(json_special::classify(x), html), _mm256_cmpeq_epi8(x, _mm256_set1_epi8(static_cast<char>(0xE2))));
+            }
+#endif
+
+            template <typename Output>
+            static const char* replace(Output& rendered, const char* p, const char* e)
+            {
+                switch (*p)
+                {
+                case '\'': append(rendered, "\\'"); return p + 1;
+                case '<':
+                case '>':
+                case '&':  append_code_unit(rendered, static_cast<unsigned char>(*p)); return p + 1;
+                case static_cast<char>(0xE2):
+                    // U+2028 and U+2029 are E2 80 A8 and E2 80 A9 in UTF-8, other characters starting with E2 are copied
+                    if (e - p >= 3 && p[1] == static_cast<char>(0x80) && (p[2] == static_cast<char>(0xA8) || p[2] == static_cast<char>(0xA9)))
+                    {
+                        append(rendered, p[2] == static_cast<char>(0xA8) ? "\\u2028" : "\\u2029");
+                        return p + 3;
+                    }
+
+                    rendered.append(p, 1);
+                    return p + 1;
+                default:
+                    return json_special::replace(rendered, p, e);
+                }
+            }
+        };
+
+        /**
+         * url_special
+         *
+         * @brief   Characters that must be percent encoded in a URL component, i.e. all but the unreserved ones of RFC 3986
+         */
+        struct url_special
+        {
+            static bool is_special(unsigned char c)
+            {
+                const bool unreserved = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                                        c == '-' || c == '_' || c == '.' || c == '~';
+                return !unreserved;
+            }
+
+#if TUFT_SSE2
+            static __m128i classify(__m128i x)
+            {
+                __m128i unreserved = _mm_or_si128(_mm_or_si128(in_range_sse2(x, 'a', 'z'), in_range_sse2(x, 'A', 'Z')),
+                                                  _mm_or_si128(in_range_sse2(x, '0', '9'), _mm_cmpeq_epi8(x, _mm_set1_epi8('~'))));
+                unreserved = _mm_or_si128(unreserved, _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('-')), _mm_cmpeq_epi8(x, _mm_set1_epi8('_'))),
+                                                                   _mm_cmpeq_epi8(x, _mm_set1_epi8('.'))));
+
+                return _mm_xor_si128(unreserved, _mm_set1_epi8(-1));
+            }
+#endif
+
+#if TUFT_AVX2
+            __attribute__((target("avx2")))
+            static __m256i classify(__m256i x)
+            {
+                __m256i unreserved = _mm256_or_si256(_mm256_or_si256(in_range_avx2(x, 'a', 'z'), in_range_avx2(x, 'A', 'Z')),
+                                                     _mm256_or_si256(in_range_avx2(x, '0', '9'), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('~'))));
+                unreserved = _mm256_or_si256(unreserved, _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('-')), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_'))),
+                                                                         _mm256_cmpeq_epi8(x, _mm256_set1_epi8('.'))));
+
+                return _mm256_xor_si256(unreserved, _mm256_set1_epi8(-1));
+            }
+#endif
+
+            template <typename Output>
+            static const char* replace(Output& rendered, const char* p, const char*)
+            {
+                const unsigned char c = static_cast<unsigned char>(*p);
+                const char sequence[3] = { '%', hex_digits[c >> 4], hex_digits[c & 0x0F] };
+
+                rendered.append(sequence, sizeof(sequence));
+                return p + 1;
+            }
+        };
+
+        /**
+         * find_special_scalar
+         *
+         * @brief   Portable version of find_special()
+         */
+        template <typename Special>
+        const char* find_special_scalar(const char* b, const char* e)
+        {
+            while (b != e && !Special::is_special(static_cast<unsigned char>(*b)))
+                ++b;
+
+            return b;
+        }
+
+#if TUFT_SSE2
+        /**
+         * find_special_sse2
+         *
+         * @brief   SSE2 version of find_special(). Checks 16 characters at a time.
+         */
+        template <typename Special>
+        const char* find_special_sse2(const char* b, const char* e)
+        {
+            for (; e - b >= 16; b += 16)
+            {
+                unsigned mask = _mm_movemask_epi8(Special::classify(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b))));
+
+                if (mask != 0)
+                    return b + lowest_bit(mask);
+            }
+
+            return find_special_scalar<Special>(b, e);
+        }
+#endif
+
+#if TUFT_AVX2
+        /**
+         * find_special_avx2
+         *
+         * @brief   AVX2 version of find_special(). Checks 32 characters at a time.
+         */
+        template <typename Special>
+        __attribute__((target("avx2")))
+        const char* find_special_avx2(const char* b, const char* e)
+        {
+            for (; e - b >= 32; b += 32)
+            {
+                unsigned mask = _mm256_movemask_epi8(Special::classify(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b))));
+
+                if (mask != 0)
+                    return b + lowest_bit(mask);
+            }
+
+            return find_special_sse2<Special>(b, e);
+        }
+#endif
+
+        /**
+         * find_special
+         *
+         * @return  Pointer to the first character in [b, e) that the escaper replaces or e if there is none
+         *
+         * @note    Uses the widest vector instructions that the cpu supports
+         */
+        template <typename Special>
+        const char* find_special(const char* b, const char* e)
+        {
+#if TUFT_AVX2
+            if (has_avx2())
+                return find_special_avx2<Special>(b, e);
+#endif
+
+#if TUFT_SSE2
+            return find_special_sse2<Special>(b, e);
+#else
+            return find_special_scalar<Special>(b, e);
+#endif
+        }
+
+        /**
+         * escape_special
+         *
+         * @brief   Appends text to the rendered output with the special characters of an escaper replaced
+         *
+         * @note    Runs of characters that don't need escaping are copied in one append
+         */
+        template <typename Special, typename Output>
+        void escape_special(Output& rendered, string_view_t text)
+        {
+            const char* b = text.data();
+            const char* e = b + text.size();
+
+            while (true)
+            {
+                const char* special = find_special<Special>(b, e);
+                rendered.append(b, special - b);
+
+                if (special == e)
+                    break;
+
+                b = Special::replace(rendered, special, e);
+            }
+        }
+
+        /**
+         * append_text
+         *
+         * @brief   Appends text to the rendered output, escaped by the escape policy if requested
+         */
+        template <typename Escape = html_escape, typename Output>
+        void append_text(Output& rendered, string_view_t text, bool escape)
+        {
+            if (escape)
+                Escape::escape(rendered, text);
+            else
+                append(rendered, text);
+        }
+
+        /**
+         * find_member
+         *
+         * @return  Iterator to the member of an object or end() if there is none or the element isn't an object
+         */
+        inline json_t::const_iterator find_member(const json_t& elem, string_view_t name)
+        {
+#if NLOHMANN_JSON_VERSION_MAJOR > 3 || (NLOHMANN_JSON_VERSION_MAJOR == 3 && NLOHMANN_JSON_VERSION_MINOR >= 11)
+            return elem.find(name); // heterogeneous lookup, no temporary key
+#else
+            return elem.find(string_t(name));
+#endif
+        }
+
+        /**
+         * find_value
+         *
+         * @brief   Looks up the value of a variable tag in the current element
+         *
+         * @param   implicit    True if the tag refers to the current element itself, i.e. "{{.}}" or "{{}}"
+         *
+         * @return  Pointer to the value or nullptr if the variable is missed
+         */
+        inline const json_t* find_value(const json_t& current_elem, string_view_t name, bool implicit)
+        {
+            auto found = find_member(current_elem, name);
+
+            if (found != current_elem.end())
+                return &*found;
+
+            return implicit ? &current_elem : nullptr;
+        }
+
+        /**
+         * find_section
+         *
+         * @return  Element a section tag refers to. Missing sections are null, which is falsey.
+         */
+        inline const json_t& find_section(const json_t& current_elem, string_view_t name)
+        {
+            static const json_t null_elem;
+            auto found = find_member(current_elem, name);
+
+            return found != current_elem.end() ? *found : null_elem;
+        }
+
+        /**
+         * has_safe_numbers
+         *
+         * @brief   True if an escape policy leaves the text of numbers unchanged. Policies without safe_numbers escape them.
+         */
+        template <typename Escape, typename = void>
+        struct has_safe_numbers : std::false_type {};
+
+        template <typename Escape>
+        struct has_safe_numbers<Escape, std::void_t<decltype(Escape::safe_numbers)>> : std::bool_constant<Escape::safe_numbers> {};
+
+        /**
+         * append_number
+         *
+         * @brief   Appends a number to the rendered output without allocating or depending on the locale
+         *
+         * @param escape    True if the number is passed through the escape policy. Policies with safe numbers are skipped.
+         *
+         * @note    Floating point numbers are written in their shortest form that round trips, e.g. "1.5"
+         */
+        template <typename Escape = no_escape, typename Output, typename T>
+        void append_number(Output& rendered, T value, bool escape = false)
+        {
+            char buffer[32]; // Enough for any 64 bit integer or the shortest form of a double
+            auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+            const string_view_t text(buffer, result.ptr - buffer);
+
+            if constexpr (has_safe_numbers<Escape>::value)
+                append(rendered, text);
+            else
+                append_text<Escape>(rendered, text, escape); // e.g. the "+" of "1e+21" in a url
+        }
+
+        /**
+         * append_value
+         *
+         * @brief   Appends the value of a variable tag to the rendered output
+         *
+         * @param value         Value of the variable
+         * @param escape        True if the value is passed through the escape policy
+         */
+        template <typename Escape = html_escape, typename Output>
+        void append_value(Output& rendered, const json_t& value, bool escape)
+        {
+            switch (value.type())
+            {
+                case json_t::value_t::object:
+                case json_t::value_t::array:
+                    append_text<Escape>(rendered, value.dump(), escape);
+                    break;
+
+                case json_t::value_t::null:
+                    append(rendered, "null");
+                    break;
+
+                // Numbers are only escaped by policies that would change them, see has_safe_numbers
+                case json_t::value_t::number_float:
+                    append_number<Escape>(rendered, value.get<double>(), escape);
+                    break;
+
+                case json_t::value_t::number_integer:
+                    append_number<Escape>(rendered, value.get<int64_t>(), escape);
+                    break;
+
+                case json_t::value_t::number_unsigned:
+                    append_number<Escape>(rendered, value.get<uint64_t>(), escape);
+                    break;
+
+                case json_t::value_t::boolean:
+                    append(rendered, value.get<bool>() ? "true" : "false");
+                    break;
+
+                case json_t::value_t::string:
+                    // Reference to the json's own string, it isn't copied before being appended
+                    append_text<Escape>(rendered, value.get_ref<const string_t&>(), escape);
+                    break;
+
+                case json_t::value_t::discarded:
+                    break;
+
+                default:
+                    append_text<Escape>(rendered, value.dump(), escape);
+                    break;
+            }
+        }
+
+        /**
+         * for_each_element
+         *
+         * @brief   Calls f with each element of an array, or once with the element itself if it isn't an array
+         */
+        template <typename F>
+        void for_each_element(const json_t& element, F&& f)
+        {
+            if (!element.is_array())
+            {
+                f(element);
+                return;
+            }
+
+            for (const auto& current_elem : element)
+                f(current_elem);
+        }
+
+        /**
+         * is_section_rendered
+         *
+         * @return  True if the interior of a section over this element should be rendered
+         */
+        inline bool is_section_rendered(const json_t& current_elem, bool is_inverted)
+        {
+            bool render_interior = false;
+
+            switch (current_elem.type())
+            {
+                case json_t::value_t::array:
+                case json_t::value_t::object:
+                    render_interior = true;
+                    break;
+
+                case json_t::value_t::boolean:
+                    render_interior = current_elem.get<bool>();
+                    break;
+
+                case json_t::value_t::discarded:
+                case json_t::value_t::null:
+                case json_t::value_t::number_float:
+                case json_t::value_t::number_integer:
+                case json_t::value_t::number_unsigned:
+                default:
+                    break;
+            }
+
+            if (is_inverted)
+                render_interior = !render_interior;
+
+            return render_interior;
+        }
+
+        /**
+         * tokenize
+         *
+         * @brief Splits the template into nodes in a single pass
+         *
+         * @note  Open sections are kept on a stack and matched against closing tags as they are found,
+         *        so the template is scanned once regardless of how deeply sections are nested.
+         */
+        template <typename Delimiters, typename Storage>
+        void tokenize(const template_t& t, Storage& compiled, const Delimiters& delims, const options_t& opts)
+        {
+            // Node positions are 32 bit, names that aren't a part of the source at most double the text
+            if (t.size() > std::numeric_limits<uint32_t>::max() / 2)
+                throw exception("tuft::compile - Template is too large");
+
+            // An empty delimiter is found again where it was found, no tag would ever end
+            if (delims.open().empty() || delims.close().empty())
+                throw exception("tuft::compile - Delimiters must not be empty");
+
+            const iter end = t.end();
+            auto& nodes = compiled.nodes;
+            compiled.text.assign(t.data(), t.size());
+
+            iter remaining_begin = t.begin();
+            iter tag_begin  = end; // Before "{{"
+            iter tag_end    = end; // After  "}}"
+
+            // Each tag adds at most two nodes, itself and the literal before it. Counting them first
+            // means the nodes are allocated once.
+            size_t tag_count = 0;
+
+            for (iter it = search_delimiter(t.begin(), end, delims.open()); it != end; it = search_delimiter(next(it, delims.open().size()), end, delims.open()))
+                ++tag_count;
+
+            nodes.reserve(2 * tag_count + 1);
+
+            // Indices of the section nodes that have not been closed yet
+            std::vector<size_t, typename Storage::template rebind_t<size_t>> open_sections(compiled.nodes.get_allocator());
+            open_sections.reserve(std::min(tag_count, opts.max_depth));
+
+            // Reused for the names that aren't a contiguous part of their tag
+            decltype(compiled.text) scratch(compiled.text.get_allocator());
+
+            auto add_literal = [&](const iter& b, const iter& e)
+            {
+                if (b == e)
+                    return;
+
+                node literal;
+                literal.offset = static_cast<uint32_t>(distance(t.begin(), b));
+                literal.length = static_cast<uint32_t>(distance(b, e));
+                nodes.push_back(literal);
+
+                // Counted for the innermost open section only, nested sections may not be rendered
+                if (!open_sections.empty())
+                    nodes[open_sections.back()].literal_length += literal.length;
+            };
+
+            // Points the node at its name in the source if it is there as is, otherwise adds it after the source
+            auto set_name = [&](node& tag, const iter& b, const iter& e, string_view_t name)
+            {
+                const char* source = t.data();
+                size_t offset = 0;
+
+                if (name.data() >= source && name.data() <= source + t.size())
+                {
+                    offset = name.data() - source;
+                }
+                else
+                {
+                    auto found = std::search(b, e, name.begin(), name.end());
+                    offset = distance(t.begin(), found);
+
+                    if (found == e)
+                    {
+                        offset = compiled.text.size();
+                        compiled.text += name;
+                    }
+                }
+
+                tag.offset = static_cast<uint32_t>(offset);
+                tag.length = static_cast<uint32_t>(name.size());
+            };
+
+            auto name_of = [&](const node& tag)
+            {
+                return string_view_t(compiled.text).substr(tag.offset, tag.length);
+            };
+
+            while (find_next_tag(remaining_begin, end, tag_begin, tag_end, delims))
+            {
+                add_literal(remaining_begin, tag_begin); // This is the stuff between tags. Leave it alone.
+
+                // A tag whose close delimiter overlaps its open one, e.g. "<%>", isn't closed either. The length is
+                // checked first, so the template is long enough to end with the close delimiter.
+                if (static_cast<size_t>(distance(tag_begin, tag_end)) < delims.open().size() + delims.close().size() ||
+                    (tag_end == end && !std::equal(delims.close().rbegin(), delims.close().rend(), t.rbegin())))
+                    throw exception("tuft::compile - Could not find closing delimiter for tag '" + string_t(tag_begin, tag_end) + "'");
+
+                const tag_info info = classify_tag(tag_begin, tag_end, delims, scratch);
+                const string_view_t name = info.name;
+                bool is_inverted_section = false;
+
+                switch (info.type)
+                {
+                    case tag_type::variable:
+                    case tag_type::escaped:
+                    {
+                        node variable;
+                        variable.type   = node_type::variable;
+                        variable.escape = info.escape;
+                        variable.implicit = name.empty() || name == ".";
+                        set_name(variable, tag_begin, tag_end, name);
+                        nodes.push_back(variable);
+                        break;
+                    }
+                    // Fall through sections
+                    case tag_type::inverted_section:
+                        is_inverted_section = true;
+                        [[fallthrough]];
+
+                    case tag_type::section:
+                    {
+                        if (open_sections.size() >= opts.max_depth)
+                            throw exception("tuft::compile - Sections are nested deeper than " + std::to_string(opts.max_depth) + " levels");
+
+                        open_sections.push_back(nodes.size());
+
+                        node section;
+                        section.type = is_inverted_section ? node_type::inverted_section : node_type::section;
+                        set_name(section, tag_begin, tag_end, name);
+                        nodes.push_back(section);
+                        break;
+                    }
+
+                    case tag_type::end_section:
+                    {
+                        if (open_sections.empty() || name_of(nodes[open_sections.back()]) != name)
+                            throw exception("tuft::compile - Unexpected closing tag '" + string_t(tag_begin, tag_end) + "'");
+
+                        auto& section = nodes[open_sections.back()];
+                        section.end = static_cast<uint32_t>(nodes.size());
+                        open_sections.pop_back();
+                        break;
+                    }
+
+                    case tag_type::comment:
+                        // Comments aren't altered
+                        add_literal(tag_begin, tag_end);
+                        break;
+
+                    // Fall through bad tags
+                    case tag_type::invalid:
+                    default:
+                        throw exception("tuft::compile - Unknown tag: '" + string_t(tag_begin, tag_end));
+                        break;
+                }
+
+                // Move past current tag.
+                remaining_begin = tag_end;
+            }
+
+            // Append anything remaining after the last tag
+            add_literal(remaining_begin, end);
+
+            if (!open_sections.empty())
+            {
+                string_t name(name_of(nodes[open_sections.back()]));
+                throw exception("tuft::compile - Could not find closing tag '" + opts.delim_open + "/" + name + opts.delim_close + "'");
+            }
+        }
+
+        template <typename Storage>
+        void tokenize(const template_t& t, Storage& compiled, const options_t& opts)
+        {
+            // Delimiters are compared once per template, the default ones are constants in every tag after that
+            if (opts.delim_open == "{{" && opts.delim_close == "}}")
+                tokenize(t, compiled, mustache_delimiters(), opts);
+            else
+                tokenize(t, compiled, custom_delimiters {opts.delim_open, opts.delim_close}, opts);
+        }
+
+        /**
+         * reserve_output
+         *
+         * @brief   Makes room for at least size more characters if the output is a string. Other outputs are left alone.
+         */
+        template <typename Output>
+        void reserve_output(Output&, size_t)
+        {
+        }
+
+        template <typename Char, typename Traits, typename Allocator>
+        void reserve_output(std::basic_string<Char, Traits, Allocator>& rendered, size_t size)
+        {
+            size_t needed = rendered.size() + size;
+
+            if (needed > rendered.capacity())
+                rendered.reserve(std::max(needed, 2 * rendered.capacity()));
+        }
+
+#if TUFT_PMR
+        /**
+         * scratch_resource
+         *
+         * @brief   Memory resource for the scratch state of a render. Strings with a polymorphic allocator share theirs.
+         */
+        template <typename Output>
+        std::pmr::memory_resource* scratch_resource(const Output&)
+        {
+            return std::pmr::get_default_resource();
+        }
+
+        template <typename Char, typename Traits>
+        std::pmr::memory_resource* scratch_resource(const std::basic_string<Char, Traits, std::pmr::polymorphic_allocator<Char>>& rendered)
+        {
+            return rendered.get_allocator().resource();
+        }
+
+#endif
+        /**
+         * frame
+         *
+         * @brief   Section that is being rendered
+         */
+        struct frame
+        {
+            /** Array that the section iterates over, or nullptr if the interior is rendered once */
+            const json_t* array;
+
+            /** Index of the array element to render next and one past the last one to render */
+            size_t next;
+            size_t stop;
+
+            /** Element the interior is rendered with */
+            const json_t* context;
+
+            /** Interior of the section is [first, last) */
+            size_t first;
+            size_t last;
+        };
+
+        /**
+         * frame_stack
+         *
+         * @brief   Stack of open sections. Frames live inside the stack until it is deeper than templates usually are,
+         *          then on the heap, so the depth of a template never touches the thread's own stack.
+         */
+        class frame_stack
+        {
+        public:
+            frame_stack() = default;
+#if TUFT_PMR
+            explicit frame_stack(std::pmr::memory_resource* resource) : heap_(resource) {}
+#endif
+            frame_stack(const frame_stack&) = delete;
+            frame_stack& operator=(const frame_stack&) = delete;
+
+            bool empty() const { return size_ == 0; }
+            size_t size() const { return size_; }
+            frame& top() { return data_[size_ - 1]; }
+            void pop() { --size_; }
+
+            void push(const frame& f)
+            {
+                if (size_ == capacity_)
+                    grow();
+
+                data_[size_++] = f;
+            }
+
+        private:
+            void grow()
+            {
+                const bool on_heap = data_ != local_;
+                heap_.resize(capacity_ * 2);
+
+                if (!on_heap)
+                    std::copy(local_, local_ + size_, heap_.begin());
+
+                data_ = heap_.data();
+                capacity_ = heap_.size();
+            }
+
+            static constexpr size_t local_capacity = 16;
+
+            frame local_[local_capacity];
+            frame* data_ = local_;
+            size_t size_ = 0;
+            size_t capacity_ = local_capacity;
+#if TUFT_PMR
+            std::pmr::vector<frame> heap_;
+#else
+            std::vector<frame> heap_;
+#endif
+        };
+
+        /** @brief  Instructions of the renderer. The first ones are the node types, loop runs at the end of each section. */
+        enum class opcode : unsigned
+        {
+            literal          = static_cast<unsigned>(node_type::literal),
+            variable         = static_cast<unsigned>(node_type::variable),
+            section          = static_cast<unsigned>(node_type::section),
+            inverted_section = static_cast<unsigned>(node_type::inverted_section),
+            loop,
+        };
+
+        /**
+         * no_split
+         *
+         * @brief   Section splitter that leaves every section to the renderer
+         *
+         * @note    A splitter is called with each array a section iterates over. If it returns true it has rendered
+         *          the section itself, e.g. in parallel, and the renderer moves on after the section.
+         */
+        struct no_split
+        {
+            template <typename Output>
+            bool operator()(const compiled_template&, const json_t&, size_t, size_t, size_t, Output&)
+            {
+                return false;
+            }
+        };
+
+        /**
+         * run
+         *
+         * @param element   Json element the template is rendered with, unless chunk is set
+         * @param chunk     If set, only this frame is rendered. It is a range of elements of a section's array.
+         * @param split     Splitter that is offered every section over an array, see no_split
+         */
+        template <typename Escape, typename Output, typename Split>
+        void run(const compiled_template& ct, Output& rendered, const json_t& element, const frame* chunk, Split& split)
+        {
+            const auto nodes = ct.nodes();
+            const char* text = ct.text().data();
 
-                    switch (type)
+#if TUFT_PMR
+            frame_stack stack(scratch_resource(rendered));
+#else
+            frame_stack stack;
+#endif
+            size_t pc = 0;
+
+            // Context and end of the innermost section, copied out of its frame
+            const json_t* context = nullptr;
+            size_t last = 0;
+
+            const size_t max_depth = ct.options().max_depth;
+
+            // Starts rendering [first, last) once per array element or once with the element itself
+            auto enter = [&](const json_t& elem, size_t first, size_t end, size_t literal_length)
+            {
+                // Templates are checked when they are compiled, this catches deserialized ones.
+                // The first frame is the top level element's, the others are sections.
+                if (stack.size() > max_depth)
+                    throw exception("tuft::render - Sections are nested deeper than " + std::to_string(max_depth) + " levels");
+
+                if (elem.is_array())
+                {
+                    if (elem.empty() || split(ct, elem, first, end, literal_length, rendered))
                     {
-                        case tag_type::variable:
-                        case tag_type::escaped:
-                        {
-                            bool found = current_elem.count(name) > 0;
-                            bool should_exist = !name.empty() && name != ".";
-
-                            // Variable misses are ignored
-                            if (!found && should_exist)
-                                break;
-
-                            json_t elem = found ? current_elem[name] : current_elem;
-
-                            string_t val;
-
-                            switch (elem.type())
-                            {
-                                case json_t::value_t::object:
-                                case json_t::value_t::array:
-                                    val = elem.dump();
-                                    break;
-
-                                case json_t::value_t::null:
-                                    val = "null";
-                                    break;
-
-                                case json_t::value_t::number_float:
-                                    val = to_string(elem.get<double>());
-                                    break;
-
-                                case json_t::value_t::number_integer:
-                                    val = to_string(elem.get<int64_t>());
-                                    break;
-
-                                case json_t::value_t::number_unsigned:
-                                    val = to_string(elem.get<uint64_t>());
-                                    break;
-
-                                case json_t::value_t::boolean:
-                                    val = elem.get<bool>() ? "true" : "false";
-                                    break;
-
-                                case json_t::value_t::string:
-                                    val = elem; // implicit conversion
-                                    break;
-
-                                case json_t::value_t::discarded:
-                                    break;
-                                    
-                                default:
-                                    val = elem.dump();
-                                    break;
-                            }
-
-                            if (should_escape(tag_begin, tag_end, opts))
-                                rendered += escape_html(val);
-                            else
-                                rendered += val;
-
-                            break;
-                        }
-                        // Fall through sections
-                        case tag_type::inverted_section:
-                            is_inverted_section = true;
-
-                        case tag_type::section:
-                        {
-                            auto close_section_tag = opts.delim_open + "/" + name + opts.delim_close;
-                            auto close_tag_begin   = search(tag_end, end, close_section_tag.begin(), close_section_tag.end());
-
-                            if (close_tag_begin == end)
-                                throw exception("tuft::render - Could not find closing tag '" + close_section_tag + "'");
-
-                            render_section(t, tag_end, close_tag_begin, rendered, current_elem[name], opts, is_inverted_section);
-
-                            // Move after section's closing tag for next round
-                            tag_end = next(close_tag_begin, close_section_tag.size());
-                            break;
-                        }
-
-                        case tag_type::comment:
-                            // Comments aren't altered
-                            rendered.append(tag_begin, next(tag_end, opts.delim_close.size()));
-                            break;
-
-                        // Fall through bad tags
-                        case tag_type::invalid:
-                        default:
-                            throw exception("tuft::render - Unknown tag: '" + string_t(tag_begin, tag_end));
-                            break;
+                        pc = end;
+                        return;
                     }
 
-                    // Move past current tag.
-                    remaining_begin = tag_end;
+                    // The range is rendered once per element. Make room for its literal text up front.
+                    reserve_output(rendered, elem.size() * literal_length);
+                    stack.push(frame {&elem, 1, elem.size(), &elem[0], first, end});
+                }
+                else
+                {
+                    stack.push(frame {nullptr, 0, 0, &elem, first, end});
+                }
+
+                context = stack.top().context;
+                last = end;
+                pc = first;
+            };
+
+            if (chunk != nullptr)
+            {
+                stack.push(*chunk);
+                context = chunk->context;
+                last = chunk->last;
+                pc = chunk->first;
+            }
+            else
+            {
+                enter(element, 0, nodes.size(), 0);
+            }
+
+            if (stack.empty())
+                return;
+
+            // A section never ends past its parent. Checking pc >= last keeps corrupt nodes inside it all the same.
+            auto next_opcode = [&]
+            {
+                return pc < last ? static_cast<opcode>(nodes[pc].type) : opcode::loop;
+            };
+
+#if TUFT_COMPUTED_GOTO
+            #pragma GCC diagnostic push
+            #pragma GCC diagnostic ignored "-Wpedantic"
+
+            static const void* const labels[] = { &&op_literal, &&op_variable, &&op_section, &&op_inverted_section, &&op_loop };
+
+            #define TUFT_OP(name) op_##name
+            #define TUFT_NEXT()   goto *labels[static_cast<unsigned>(next_opcode())]
+
+            TUFT_NEXT();
+#else
+            #define TUFT_OP(name) case opcode::name
+            #define TUFT_NEXT()   continue
+
+            for (;;) switch (next_opcode())
+#endif
+            {
+                TUFT_OP(literal):
+                {
+                    const node& tag = nodes[pc++];
+                    rendered.append(text + tag.offset, tag.length);
+                    TUFT_NEXT();
+                }
+
+                TUFT_OP(variable):
+                {
+                    const node& tag = nodes[pc++];
+
+                    // Variable misses are ignored
+                    if (const json_t* value = find_value(*context, ct.text(tag), tag.implicit))
+                        append_value<Escape>(rendered, *value, tag.escape);
+
+                    TUFT_NEXT();
+                }
+
+                TUFT_OP(section):
+                TUFT_OP(inverted_section):
+                {
+                    const node& tag = nodes[pc];
+                    const json_t& section_elem = find_section(*context, ct.text(tag));
+
+                    if (is_section_rendered(section_elem, tag.type == node_type::inverted_section))
+                        enter(section_elem, pc + 1, tag.end, tag.literal_length);
+                    else
+                        pc = tag.end;
+
+                    TUFT_NEXT();
                 }
 
-                // Append anything remaining after tag. In a section this would be the remainder of the section interior
-                rendered.append(remaining_begin, end);
+                TUFT_OP(loop):
+                {
+                    frame& f = stack.top();
+
+                    if (f.next < f.stop)
+                    {
+                        context = f.context = &(*f.array)[f.next++];
+                        pc = f.first;
+                        TUFT_NEXT();
+                    }
+
+                    // Continue after the section's closing tag
+                    pc = f.last;
+                    stack.pop();
+
+                    if (stack.empty())
+                        return;
+
+                    context = stack.top().context;
+                    last = stack.top().last;
+                    TUFT_NEXT();
+                }
             }
+
+            #undef TUFT_OP
+            #undef TUFT_NEXT
+
+#if TUFT_COMPUTED_GOTO
+            #pragma GCC diagnostic pop
+#endif
+        }
+
+        template <typename Escape, typename Output>
+        void execute(const compiled_template& ct, Output& rendered, const json_t& element)
+        {
+            no_split split;
+            run<Escape>(ct, rendered, element, nullptr, split);
+        }
+
+        /**
+         * execute_chunk
+         *
+         * @brief   Renders the interior [first, last) of a section once for each element of its array in [begin, end)
+         */
+        template <typename Escape, typename Output>
+        void execute_chunk(const compiled_template& ct, Output& rendered, const json_t& array, size_t begin, size_t end, size_t first, size_t last)
+        {
+            if (begin >= end)
+                return;
+
+            const frame chunk {&array, begin + 1, end, &array[begin], first, last};
+
+            no_split split;
+            run<Escape>(ct, rendered, array, &chunk, split);
         }
 
     } // detail
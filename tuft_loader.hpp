@@ -0,0 +1,552 @@
+/*
+ * Copyright 2016 Charles Jared Jetsel
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the "Software"), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons
+ * to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <thread>
+
+#include "tuft.hpp"
+
+#if defined(__linux__)
+    #include <poll.h>
+    #include <sys/inotify.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace tuft
+{
+    namespace detail
+    {
+        /**
+         * bundle_header
+         *
+         * @brief   Start of a bundle file. It is followed by an entry per template and then the names and serialized templates.
+         */
+        struct bundle_header
+        {
+            char     magic[4];
+            uint16_t version;
+            uint16_t byte_order;
+            uint32_t count;
+            uint32_t reserved;
+        };
+
+        /** @brief  Position of a template's name and serialized form in a bundle file */
+        struct bundle_entry
+        {
+            uint64_t name_offset;
+            uint64_t blob_offset;
+            uint64_t blob_size;
+            uint32_t name_size;
+            uint32_t reserved;
+        };
+
+        const char bundle_magic[4] = { 'T', 'U', 'F', 'B' };
+
+        /**
+         * map_file
+         *
+         * @return  Read only contents of a file and the owner that keeps them alive. Mapped where the OS supports it.
+         */
+        inline std::pair<string_view_t, std::shared_ptr<const void>> map_file(const std::filesystem::path& file)
+        {
+#if defined(__unix__) || defined(__APPLE__)
+            int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+
+            if (fd >= 0)
+            {
+                struct stat info;
+                void* mapped = MAP_FAILED;
+
+                if (::fstat(fd, &info) == 0 && info.st_size > 0)
+                    mapped = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+                ::close(fd);
+
+                if (mapped != MAP_FAILED)
+                {
+                    size_t size = static_cast<size_t>(info.st_size);
+                    std::shared_ptr<const void> owner(mapped, [size](const void* p) { ::munmap(const_cast<void*>(p), size); });
+
+                    return { string_view_t(static_cast<const char*>(mapped), size), std::move(owner) };
+                }
+            }
+#endif
+            std::ifstream in(file, std::ios::binary);
+
+            if (!in)
+                throw exception("tuft::load_bundle - Could not open '" + file.string() + "'");
+
+            std::ostringstream contents;
+            contents << in.rdbuf();
+
+            auto owner = std::make_shared<const string_t>(contents.str());
+            return { string_view_t(*owner), owner };
+        }
+    }
+
+    /**
+     * save_bundle
+     * @brief   Writes compiled templates and their names to one file that load_bundle() can map
+     *
+     * @param   file        Path of the bundle file
+     * @param   templates   Named templates, e.g. template_registry::snapshot()
+     */
+    inline void save_bundle(const std::filesystem::path& file, const template_registry::map_t& templates)
+    {
+        using detail::bundle_entry;
+
+        detail::bundle_header header {};
+        std::memcpy(header.magic, detail::bundle_magic, sizeof(header.magic));
+        header.version    = detail::blob_version;
+        header.byte_order = detail::blob_byte_order;
+        header.count      = static_cast<uint32_t>(templates.size());
+
+        std::vector<bundle_entry> entries;
+        string_t data;
+
+        uint64_t data_offset = sizeof(header) + templates.size() * sizeof(bundle_entry);
+
+        for (const auto& named : templates)
+        {
+            bundle_entry entry {};
+            entry.name_offset = data_offset + data.size();
+            entry.name_size   = static_cast<uint32_t>(named.first.size());
+            data += named.first;
+
+            // Serialized templates start 8 byte aligned so their nodes can be used in place
+            data.resize((data.size() + 7) & ~size_t(7), '\0');
+
+            string_t blob = serialize(*named.second);
+            entry.blob_offset = data_offset + data.size();
+            entry.blob_size   = blob.size();
+            data += blob;
+
+            entries.push_back(entry);
+        }
+
+        std::ofstream out(file, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(bundle_entry));
+        out.write(data.data(), data.size());
+
+        if (!out)
+            throw exception("tuft::save_bundle - Could not write '" + file.string() + "'");
+    }
+
+    /**
+     * load_bundle
+     * @brief   Loads every template from a file written by save_bundle() with a single mapping of the file
+     *
+     * @param   file    Path of the bundle file
+     * @return  Named templates that use the mapped file in place. It stays mapped while any of them is alive.
+     *
+     * @throw   tuft::exception if the file is missing, corrupt or from another version
+     */
+    inline template_registry::map_t load_bundle(const std::filesystem::path& file)
+    {
+        using detail::bundle_entry;
+
+        auto mapped = detail::map_file(file);
+        string_view_t data = mapped.first;
+
+        detail::bundle_header header;
+
+        if (data.size() < sizeof(header))
+            throw exception("tuft::load_bundle - '" + file.string() + "' is too short");
+
+        std::memcpy(&header, data.data(), sizeof(header));
+
+        if (std::memcmp(header.magic, detail::bundle_magic, sizeof(header.magic)) != 0 ||
+            header.version != detail::blob_version || header.byte_order != detail::blob_byte_order)
+            throw exception("tuft::load_bundle - '" + file.string() + "' is not a bundle of this version");
+
+        if (data.size() < sizeof(header) + uint64_t(header.count) * sizeof(bundle_entry))
+            throw exception("tuft::load_bundle - '" + file.string() + "' is truncated");
+
+        template_registry::map_t templates;
+        templates.reserve(header.count);
+
+        for (uint32_t i = 0; i < header.count; ++i)
+        {
+            bundle_entry entry;
+            std::memcpy(&entry, data.data() + sizeof(header) + i * sizeof(bundle_entry), sizeof(entry));
+
+            if (entry.name_offset + entry.name_size > data.size() || entry.blob_offset + entry.blob_size > data.size())
+                throw exception("tuft::load_bundle - '" + file.string() + "' is truncated");
+
+            string_t name(data.substr(entry.name_offset, entry.name_size));
+            auto blob = data.substr(entry.blob_offset, entry.blob_size);
+
+            templates[std::move(name)] = std::make_shared<const compiled_template>(deserialize(blob, mapped.second));
+        }
+
+        return templates;
+    }
+
+    /**
+     * template_loader
+     *
+     * @brief   Loads a directory tree of template files into a template_registry and keeps it up to date
+     *
+     * @note    A template's name is its path relative to the root without the extension, e.g. "emails/welcome"
+     *          for "<root>/emails/welcome.mustache". Changed files are recompiled on a background thread and
+     *          swapped into the registry, so request threads never compile. Linux is notified of changes with
+     *          inotify. Other platforms compare modification times every poll interval.
+     */
+    class template_loader
+    {
+    public:
+        using path_t = std::filesystem::path;
+
+        /** @brief  Called from the watcher thread when a changed file can't be loaded. The old version is kept. */
+        using error_handler_t = std::function<void(const string_t& name, const std::exception& error)>;
+
+        template_loader(template_registry& registry, path_t root, options_t options = options_t(), string_t extension = ".mustache")
+            : registry_(registry), root_(std::move(root)), options_(std::move(options)), extension_(std::move(extension))
+        {
+        }
+
+        template_loader(const template_loader&) = delete;
+        template_loader& operator=(const template_loader&) = delete;
+
+        ~template_loader() { stop(); }
+
+        /** @brief Called for files that fail to load while watching. Set it before calling watch(). */
+        void on_error(error_handler_t handler) { on_error_ = std::move(handler); }
+
+        /** @brief Interval between scans on platforms without change notifications */
+        void poll_interval(std::chrono::milliseconds interval) { poll_interval_ = interval; }
+
+        /**
+         * load
+         * @brief   Compiles every template file under the root and publishes them to the registry at once
+         *
+         * @throw   tuft::exception naming the file if one can't be read or compiled
+         */
+        void load()
+        {
+            std::vector<std::pair<string_t, template_registry::value_t>> loaded;
+
+            for (const auto& file : std::filesystem::recursive_directory_iterator(root_))
+            {
+                if (!is_template(file.path()))
+                    continue;
+
+                try
+                {
+                    loaded.emplace_back(name_of(file.path()), compile_file(file.path()));
+                    modified_[file.path()] = file.last_write_time();
+                }
+                catch (const std::exception& e)
+                {
+                    throw exception("tuft::template_loader - Could not load '" + file.path().string() + "': " + e.what());
+                }
+            }
+
+            registry_.update([&](template_registry::map_t& templates)
+            {
+                for (auto& named : loaded)
+                    templates[named.first] = std::move(named.second);
+            });
+        }
+
+        /**
+         * watch
+         * @brief   Starts recompiling changed template files on a background thread
+         *
+         * @note    Call load() first for the initial set, watch() only picks up later changes.
+         */
+        void watch()
+        {
+            if (watcher_.joinable())
+                return;
+
+            stopping_ = false;
+
+#if defined(__linux__)
+            start_inotify();
+#else
+            watcher_ = std::thread([this] { poll_loop(); });
+#endif
+        }
+
+        /** @brief Stops watching and waits for the background thread to finish */
+        void stop()
+        {
+            stopping_ = true;
+
+#if defined(__linux__)
+            if (wake_[1] >= 0)
+            {
+                char wake = 0;
+                (void)::write(wake_[1], &wake, 1);
+            }
+#endif
+
+            if (watcher_.joinable())
+                watcher_.join();
+
+#if defined(__linux__)
+            close_inotify();
+#endif
+        }
+
+    private:
+        bool is_template(const path_t& file) const
+        {
+            return file.extension() == extension_;
+        }
+
+        string_t name_of(const path_t& file) const
+        {
+            return file.lexically_relative(root_).replace_extension().generic_string();
+        }
+
+        template_registry::value_t compile_file(const path_t& file) const
+        {
+            std::ifstream in(file, std::ios::binary);
+
+            if (!in)
+                throw exception("tuft::template_loader - Could not open '" + file.string() + "'");
+
+            std::ostringstream text;
+            text << in.rdbuf();
+
+            return std::make_shared<const compiled_template>(compile(text.str(), options_));
+        }
+
+        /** @brief Recompiles a changed file and swaps it in, or removes it if it's gone */
+        void reload(const path_t& file)
+        {
+            const string_t name = name_of(file);
+            std::error_code ec;
+
+            if (!std::filesystem::is_regular_file(file, ec))
+            {
+                registry_.erase(name);
+                modified_.erase(file);
+                return;
+            }
+
+            try
+            {
+                registry_.set(name, compile_file(file));
+                modified_[file] = std::filesystem::last_write_time(file, ec);
+            }
+            catch (const std::exception& e)
+            {
+                if (on_error_)
+                    on_error_(name, e);
+            }
+        }
+
+        /** @brief Reloads every template file under a directory, e.g. one that was just moved into the tree */
+        void reload_directory(const path_t& dir)
+        {
+            std::error_code ec;
+
+            for (auto it = std::filesystem::recursive_directory_iterator(dir, ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+            {
+#if defined(__linux__)
+                if (it->is_directory(ec))
+                    add_watch(it->path());
+#endif
+                if (is_template(it->path()))
+                    reload(it->path());
+            }
+        }
+
+        /** @brief Compares modification times with the previous scan and reloads the differences */
+        void scan()
+        {
+            std::error_code ec;
+            std::map<path_t, std::filesystem::file_time_type> seen;
+
+            for (auto it = std::filesystem::recursive_directory_iterator(root_, ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+            {
+                if (!is_template(it->path()))
+                    continue;
+
+                auto time = it->last_write_time(ec);
+                seen[it->path()] = time;
+
+                auto known = modified_.find(it->path());
+
+                if (known == modified_.end() || known->second != time)
+                    reload(it->path());
+            }
+
+            for (auto it = modified_.begin(); it != modified_.end();)
+            {
+                const path_t file = (it++)->first;
+
+                if (seen.count(file) == 0)
+                    reload(file);
+            }
+        }
+
+        void poll_loop()
+        {
+            while (!stopping_)
+            {
+                std::this_thread::sleep_for(poll_interval_);
+                scan();
+            }
+        }
+
+#if defined(__linux__)
+        void add_watch(const path_t& dir)
+        {
+            const uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_DELETE_SELF;
+            int wd = inotify_add_watch(inotify_, dir.c_str(), mask);
+
+            if (wd >= 0)
+                directories_[wd] = dir;
+        }
+
+        void start_inotify()
+        {
+            inotify_ = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+
+            if (inotify_ < 0 || ::pipe(wake_) != 0)
+            {
+                // No notifications available, fall back to scanning
+                close_inotify();
+                watcher_ = std::thread([this] { poll_loop(); });
+                return;
+            }
+
+            // inotify isn't recursive, every directory in the tree gets its own watch
+            add_watch(root_);
+
+            std::error_code ec;
+
+            for (auto it = std::filesystem::recursive_directory_iterator(root_, ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+            {
+                if (it->is_directory(ec))
+                    add_watch(it->path());
+            }
+
+            watcher_ = std::thread([this] { inotify_loop(); });
+        }
+
+        void inotify_loop()
+        {
+            alignas(inotify_event) char buffer[16 * 1024];
+
+            while (!stopping_)
+            {
+                pollfd fds[2] = { { inotify_, POLLIN, 0 }, { wake_[0], POLLIN, 0 } };
+
+                if (::poll(fds, 2, -1) < 0 || stopping_)
+                    continue;
+
+                ssize_t size;
+
+                while ((size = ::read(inotify_, buffer, sizeof(buffer))) > 0)
+                {
+                    for (char* p = buffer; p < buffer + size; p += sizeof(inotify_event) + reinterpret_cast<inotify_event*>(p)->len)
+                    {
+                        const auto* event = reinterpret_cast<const inotify_event*>(p);
+                        auto dir = directories_.find(event->wd);
+
+                        if (dir == directories_.end())
+                            continue;
+
+                        if (event->mask & IN_DELETE_SELF)
+                        {
+                            directories_.erase(dir);
+                            continue;
+                        }
+
+                        if (event->len == 0)
+                            continue;
+
+                        const path_t file = dir->second / event->name;
+
+                        if (event->mask & IN_ISDIR)
+                        {
+                            if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                            {
+                                add_watch(file);
+                                reload_directory(file);
+                            }
+                            else if (event->mask & IN_MOVED_FROM)
+                            {
+                                scan(); // templates under the directory went with it
+                            }
+                        }
+                        else if (is_template(file) && !(event->mask & IN_CREATE))
+                        {
+                            // Created files are picked up when they are closed after writing
+                            reload(file);
+                        }
+                    }
+                }
+            }
+        }
+
+        void close_inotify()
+        {
+            for (int* fd : { &inotify_, &wake_[0], &wake_[1] })
+            {
+                if (*fd >= 0)
+                    ::close(*fd);
+
+                *fd = -1;
+            }
+
+            directories_.clear();
+        }
+
+        int inotify_ = -1;
+        int wake_[2] = { -1, -1 };
+        std::map<int, path_t> directories_;
+#endif
+
+        template_registry& registry_;
+        path_t root_;
+        options_t options_;
+        string_t extension_;
+
+        error_handler_t on_error_;
+        std::chrono::milliseconds poll_interval_ {250};
+
+        /** Modification times of the loaded files. Only used by load() and then the watcher thread. */
+        std::map<path_t, std::filesystem::file_time_type> modified_;
+
+        std::atomic<bool> stopping_ {false};
+        std::thread watcher_;
+    };
+}
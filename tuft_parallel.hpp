@@ -0,0 +1,364 @@
+/*
+ * Copyright 2016 Charles Jared Jetsel
+ *
+ * MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this
+ * software and associated documentation files (the "Software"), to deal in the Software
+ * without restriction, including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons
+ * to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR
+ * PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <iterator>
+#include <thread>
+
+#include "tuft.hpp"
+
+namespace tuft
+{
+    /**
+     * thread_pool
+     *
+     * @brief   Fixed set of worker threads that tuft's parallel renders hand their work to
+     *
+     * @note    Work is split into indices that idle threads claim one at a time, so a thread that finishes
+     *          early takes over the remaining work instead of waiting on a fixed share. A thread waiting
+     *          for its work to finish claims indices as well, so work can be started from inside the pool
+     *          without deadlocking and a pool of any size makes progress.
+     */
+    class thread_pool
+    {
+    public:
+        /** @param threads   Number of worker threads. Defaults to one per core. */
+        explicit thread_pool(size_t threads = std::max<size_t>(std::thread::hardware_concurrency(), 1))
+        {
+            for (size_t i = 0; i < threads; ++i)
+                threads_.emplace_back([this] { work(); });
+        }
+
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+
+        /** @brief Finishes the queued tasks and joins the workers */
+        ~thread_pool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+            }
+
+            wake_.notify_all();
+
+            for (auto& thread : threads_)
+                thread.join();
+        }
+
+        /** @brief Number of worker threads */
+        size_t size() const { return threads_.size(); }
+
+        /**
+         * parallel_for
+         * @brief   Calls f(i) for every i in [0, count) on the workers and the calling thread, and waits for all of them
+         *
+         * @throw   The first exception thrown by f, once all calls have finished
+         */
+        template <typename F>
+        void parallel_for(size_t count, F&& f)
+        {
+            run_loop(count, [&f](size_t i, size_t) { f(i); });
+        }
+
+        /**
+         * parallel_for_slots
+         * @brief   Like parallel_for(), but calls f(i, slot) where slot is below slots(count) and is only used by one
+         *          thread during the loop, e.g. to index per thread scratch buffers owned by the caller
+         *
+         * @throw   The first exception thrown by f, once all calls have finished
+         */
+        template <typename F>
+        void parallel_for_slots(size_t count, F&& f)
+        {
+            run_loop(count, [&f](size_t i, size_t slot) { f(i, slot); });
+        }
+
+        /** @brief Number of slots a parallel_for_slots() over count indices uses */
+        size_t slots(size_t count) const { return std::min(count, threads_.size() + 1); }
+
+    private:
+        /** @brief  Indices of a parallel_for() that are claimed one at a time by whichever thread gets there first */
+        struct loop_state
+        {
+            size_t count = 0;
+            std::function<void(size_t, size_t)> body;
+            std::atomic<size_t> next {0};
+
+            std::mutex mutex;
+            std::condition_variable finished;
+            size_t done = 0;
+            std::exception_ptr error;
+
+            void run(size_t slot)
+            {
+                // Completions are published once on the way out, not per index
+                size_t ran = 0;
+                std::exception_ptr failed;
+
+                for (size_t i = next++; i < count; i = next++, ++ran)
+                {
+                    try
+                    {
+                        body(i, slot);
+                    }
+                    catch (...)
+                    {
+                        if (!failed)
+                            failed = std::current_exception();
+                    }
+                }
+
+                if (ran == 0)
+                    return;
+
+                std::lock_guard<std::mutex> lock(mutex);
+
+                if (failed && !error)
+                    error = failed;
+
+                done += ran;
+
+                if (done == count)
+                    finished.notify_all();
+            }
+        };
+
+        template <typename Body>
+        void run_loop(size_t count, Body&& body)
+        {
+            if (count == 0)
+                return;
+
+            auto state = std::make_shared<loop_state>();
+            state->count = count;
+            state->body  = std::forward<Body>(body);
+
+            // Helpers that start after the loop is done find nothing left to claim
+            const size_t helpers = slots(count) - 1;
+
+            if (helpers > 0)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+
+                    for (size_t slot = 1; slot <= helpers; ++slot)
+                        tasks_.emplace_back([state, slot] { state->run(slot); });
+                }
+
+                wake_.notify_all();
+            }
+
+            state->run(0);
+
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->finished.wait(lock, [&] { return state->done == count; });
+
+            if (state->error)
+                std::rethrow_exception(state->error);
+        }
+
+        void work()
+        {
+            while (true)
+            {
+                std::function<void()> task;
+
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    wake_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+
+                    if (tasks_.empty())
+                        return;
+
+                    task = std::move(tasks_.front());
+                    tasks_.pop_front();
+                }
+
+                task();
+            }
+        }
+
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::deque<std::function<void()>> tasks_;
+        bool stopping_ = false;
+        std::vector<std::thread> threads_;
+    };
+
+    /**
+     * parallel_options_t
+     *
+     * @brief   Holds when and how a parallel render splits sections
+     */
+    struct parallel_options_t
+    {
+        /** Sections over arrays with at least this many elements are rendered in parallel. Default is 4096 */
+        size_t min_elements = 4096;
+
+        /** Number of elements each task renders. Default is 512 */
+        size_t chunk_elements = 512;
+    };
+
+    namespace detail
+    {
+        /**
+         * parallel_split
+         *
+         * @brief   Section splitter that renders large arrays in chunks on a thread pool and joins them in order
+         *
+         * @note    Sections inside a chunk are rendered serially, the chunks already keep the pool busy.
+         */
+        template <typename Escape>
+        struct parallel_split
+        {
+            thread_pool& pool;
+            const parallel_options_t& options;
+
+            template <typename Output>
+            bool operator()(const compiled_template& ct, const json_t& array, size_t first, size_t last, size_t literal_length, Output& rendered)
+            {
+                if (array.size() < options.min_elements)
+                    return false;
+
+                const size_t chunk_size = std::max<size_t>(options.chunk_elements, 1);
+                std::vector<string_t> chunks((array.size() + chunk_size - 1) / chunk_size);
+
+                pool.parallel_for(chunks.size(), [&](size_t c)
+                {
+                    const size_t begin = c * chunk_size;
+                    const size_t end   = std::min(begin + chunk_size, array.size());
+
+                    chunks[c].reserve((end - begin) * literal_length);
+                    execute_chunk<Escape>(ct, chunks[c], array, begin, end, first, last);
+                });
+
+                for (const auto& chunk : chunks)
+                    rendered.append(chunk.data(), chunk.size());
+
+                return true;
+            }
+        };
+    }
+
+    namespace detail
+    {
+        template <typename SinkFactory>
+        void render_batch(const compiled_template & compiled, const json_t* contexts, size_t count, SinkFactory& factory, thread_pool & pool)
+        {
+            // One buffer per thread for the length of the batch, it stops allocating once it is big enough
+            std::vector<string_t> buffers(pool.slots(count));
+
+            pool.parallel_for_slots(count, [&](size_t i, size_t slot)
+            {
+                auto& buffer = buffers[slot];
+                render_into(buffer, compiled, contexts[i]);
+
+                auto writer = factory(i);
+                writer(string_view_t(buffer));
+            });
+        }
+    }
+
+    /**
+     * render_batch
+     * @brief   Renders one compiled template with many contexts across a thread pool
+     *
+     * @param   compiled    Template returned from tuft::compile()
+     * @param   contexts    Contiguous JSON contexts, e.g. a std::vector<json_t> or std::span<const json_t>
+     * @param   factory     Callable that takes the index of a context and returns a writer for its output. The writer
+     *                      is any callable that takes a string_view_t, like the writer of a tuft::sink. It gets the whole
+     *                      output in one call, and the view is only valid during the call.
+     * @param   pool        Threads that render the contexts together with the calling thread
+     *
+     * @note    Contexts are handed to whichever thread is free next, so the factory and writers are called from
+     *          several threads at once and not in input order. Use the index to put the outputs in order.
+     */
+    template <typename Contexts, typename SinkFactory>
+    void render_batch(const compiled_template & compiled, const Contexts & contexts, SinkFactory factory, thread_pool & pool)
+    {
+        detail::render_batch(compiled, std::data(contexts), std::size(contexts), factory, pool);
+    }
+
+    /**
+     * render_batch
+     * @brief   Renders one compiled template with many contexts across a thread pool
+     *
+     * @return  Outputs in the same order as the contexts
+     */
+    template <typename Contexts>
+    std::vector<string_t> render_batch(const compiled_template & compiled, const Contexts & contexts, thread_pool & pool)
+    {
+        std::vector<string_t> rendered(std::size(contexts));
+        const json_t* first = std::data(contexts);
+
+        pool.parallel_for(rendered.size(), [&](size_t i)
+        {
+            render_into(rendered[i], compiled, first[i]);
+        });
+
+        return rendered;
+    }
+
+    /**
+     * render_append
+     * @brief   Renders hash/json values into a compiled template, splitting large array sections across a thread pool
+     *
+     * @param   out         Output string. The output is the same as from the serial render functions.
+     * @param   compiled    Template returned from tuft::compile()
+     * @param   hash        JSON object
+     * @param   pool        Threads that render the chunks of large sections together with the calling thread
+     * @param   options     Which sections are split and into how many elements per chunk
+     */
+    inline void render_append(string_t & out, const compiled_template & compiled, const json_t & hash, thread_pool & pool,
+                       const parallel_options_t & options = parallel_options_t())
+    {
+        if (compiled.source().size() == 0)
+            return;
+
+        detail::reserve_output(out, std::max(compiled.expected_size(), compiled.source().size()));
+
+        detail::with_escape(compiled.options().escape, [&](auto escape)
+        {
+            using escape_policy = decltype(escape);
+
+            detail::parallel_split<escape_policy> split {pool, options};
+            detail::run<escape_policy>(compiled, out, hash, nullptr, split);
+        });
+    }
+
+    /**
+     * render
+     * @brief   Renders hash/json values into a compiled template, splitting large array sections across a thread pool
+     *
+     * @see     render_append()
+     */
+    inline string_t render(const compiled_template & compiled, const json_t & hash, thread_pool & pool,
+                    const parallel_options_t & options = parallel_options_t())
+    {
+        string_t rendered;
+        render_append(rendered, compiled, hash, pool, options);
+
+        return rendered;
+    }
+}